@@ -0,0 +1,384 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+
+#include "../MatthewDBrown-CSC454-Homework5-CPP/ExampleModels.h"
+
+//---------------------------------------------------
+// BENCHMARKS
+//---------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Backend {
+    const char* name;
+    std::function<std::unique_ptr<EventQueueBackend>()> create;
+};
+
+static std::vector<Backend> backends() {
+    return {
+        { "binary", [] { return std::unique_ptr<EventQueueBackend>(new BinaryHeapBackend()); } },
+        { "quaternary", [] { return std::unique_ptr<EventQueueBackend>(new QuaternaryHeapBackend()); } },
+        { "calendar", [] { return std::unique_ptr<EventQueueBackend>(new CalendarQueueBackend()); } }
+    };
+}
+
+// Time from one event of a model to its next.
+struct Distribution {
+    const char* name;
+    std::function<double(std::mt19937_64&)> draw;
+};
+
+static std::vector<Distribution> distributions() {
+    return {
+        { "uniform", [](std::mt19937_64& random) { return std::uniform_real_distribution<double>(0.0, 2.0)(random); } },
+        { "exponential", [](std::mt19937_64& random) { return std::exponential_distribution<double>(1.0)(random); } },
+        { "bimodal", [](std::mt19937_64& random) {
+            double r = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+            return r < 0.9 ? r * 0.2 : 9.0 + r;
+        } },
+        // Every event of a step lands on one time, so steps are wide.
+        { "constant", [](std::mt19937_64&) { return 1.0; } }
+    };
+}
+
+// Does nothing but hand out the times the queue benchmark schedules.
+class Idle : public SimulationModel {
+public:
+    void deltaInt(double) override {}
+    void deltaExt(const Message&, double) override {}
+    void deltaCon(const Message&, double) override {}
+
+    double getNextInternalEvent() override {
+        return std::numeric_limits<double>::infinity();
+    }
+};
+
+// The classic hold model: every model keeps one pending event, and each
+// event taken off the queue is followed by the model's next one.
+static void benchmarkQueue(std::size_t maxScale) {
+    const std::size_t operations = 2000000;
+
+    std::cout << "EventQueue hold, " << operations << " pops per run" << std::endl;
+    std::cout << std::left << std::setw(12) << "backend" << std::setw(14) << "distribution"
+        << std::right << std::setw(10) << "events" << std::setw(16) << "pops/s" << std::endl;
+
+    for (const Backend& backend : backends()) {
+        for (const Distribution& distribution : distributions()) {
+            for (std::size_t scale = 100; scale <= maxScale; scale *= 10) {
+                std::mt19937_64 random(scale);
+                std::vector<Idle> models(scale);
+
+                EventPool pool;
+                EventQueue queue(pool, backend.create());
+
+                for (Idle& model : models) {
+                    queue.scheduleInternalEvent(distribution.draw(random), &model);
+                }
+
+                Clock::time_point start = Clock::now();
+                std::size_t pops = 0;
+
+                while (pops < operations) {
+                    double r = queue.timeAdvance();
+                    EventSpan events = queue.getNextEvents();
+
+                    for (const Event& event : events) {
+                        queue.scheduleInternalEvent(r + distribution.draw(random), event.getModel());
+                    }
+
+                    pops += events.size();
+                }
+
+                double seconds = secondsSince(start);
+
+                std::cout << std::left << std::setw(12) << backend.name << std::setw(14) << distribution.name
+                    << std::right << std::setw(10) << scale << std::setw(16) << std::fixed << std::setprecision(0)
+                    << pops / seconds << std::endl;
+            }
+        }
+    }
+
+    std::cout << std::endl;
+}
+
+// Couples scale Machines into a topology, feeds the first parts inputs and
+// runs it to the end.
+struct Topology {
+    const char* name;
+    std::function<void(Simulator&, std::vector<std::unique_ptr<Machine>>&, std::size_t)> couple;
+};
+
+static std::vector<Topology> topologies() {
+    return {
+        // Every part goes down the whole line.
+        { "chain", [](Simulator& sim, std::vector<std::unique_ptr<Machine>>& machines, std::size_t scale) {
+            for (std::size_t i = 0; i < scale; i++) {
+                machines.emplace_back(new Machine(1 + static_cast<int>(i % 3)));
+                sim.addModel(machines.back().get());
+
+                if (i > 0) {
+                    sim.addCoupling(machines[i - 1].get(), machines[i].get());
+                }
+            }
+
+            sim.takeOutputFrom(machines.back().get());
+        } },
+        // One machine feeding all the others, which finish in the same steps.
+        { "fan-out", [](Simulator& sim, std::vector<std::unique_ptr<Machine>>& machines, std::size_t scale) {
+            for (std::size_t i = 0; i < scale; i++) {
+                machines.emplace_back(new Machine(2));
+                sim.addModel(machines.back().get());
+
+                if (i > 0) {
+                    sim.addCoupling(machines[0].get(), machines[i].get());
+                }
+            }
+        } },
+        // A square grid whose first column feeds each row; a part reaches
+        // every cell once.
+        { "grid", [](Simulator& sim, std::vector<std::unique_ptr<Machine>>& machines, std::size_t scale) {
+            std::size_t side = static_cast<std::size_t>(std::sqrt(static_cast<double>(scale)));
+
+            for (std::size_t row = 0; row < side; row++) {
+                for (std::size_t column = 0; column < side; column++) {
+                    machines.emplace_back(new Machine(1 + static_cast<int>((row + column) % 2)));
+                    sim.addModel(machines.back().get());
+
+                    if (column > 0) {
+                        sim.addCoupling(machines[row * side + column - 1].get(), machines.back().get());
+                    }
+                    else if (row > 0) {
+                        sim.addCoupling(machines[(row - 1) * side].get(), machines.back().get());
+                    }
+                }
+            }
+        } }
+    };
+}
+
+static void benchmarkSimulator(std::size_t maxScale) {
+    const int parts = 4;
+
+    std::cout << "Simulator::simulate, " << parts << " parts per run" << std::endl;
+    std::cout << std::left << std::setw(12) << "backend" << std::setw(14) << "topology"
+        << std::right << std::setw(10) << "models" << std::setw(12) << "events" << std::setw(16) << "events/s" << std::endl;
+
+    for (const Backend& backend : backends()) {
+        for (const Topology& topology : topologies()) {
+            for (std::size_t scale = 100; scale <= maxScale; scale *= 10) {
+                Simulator sim(backend.create());
+                std::vector<std::unique_ptr<Machine>> machines;
+
+                topology.couple(sim, machines, scale);
+                sim.routeInputTo(machines.front().get());
+                sim.addInput(parts, 0.0);
+
+                Clock::time_point start = Clock::now();
+                sim.simulate();
+                double seconds = secondsSince(start);
+
+                std::cout << std::left << std::setw(12) << backend.name << std::setw(14) << topology.name
+                    << std::right << std::setw(10) << machines.size() << std::setw(12) << sim.getEventCount()
+                    << std::setw(16) << std::fixed << std::setprecision(0) << sim.getEventCount() / seconds << std::endl;
+            }
+        }
+    }
+
+    std::cout << std::endl;
+}
+
+// The chain and fan-out topologies as lanes of one MachineArray, to set
+// against the separate Machines above. An array has at most 65536 lanes.
+static void benchmarkArray(std::size_t maxScale) {
+    const int parts = 4;
+
+    std::cout << "MachineArray, " << parts << " parts per run" << std::endl;
+    std::cout << std::left << std::setw(12) << "topology" << std::right << std::setw(10) << "lanes"
+        << std::setw(12) << "events" << std::setw(16) << "lane steps/s" << std::endl;
+
+    for (const char* topology : { "chain", "fan-out" }) {
+        for (std::size_t scale = 100; scale <= std::min<std::size_t>(maxScale, 65536); scale *= 10) {
+            Simulator sim;
+            MachineArray machines(scale, 2);
+
+            sim.addModel(&machines);
+            sim.addCoupling(nullptr, 0, &machines, 0);
+
+            for (std::size_t i = 1; i < scale; i++) {
+                PortId source = std::string(topology) == "chain" ? static_cast<PortId>(i - 1) : 0;
+                sim.addCoupling(&machines, source, &machines, static_cast<PortId>(i));
+            }
+
+            sim.addInput(parts, 0.0);
+
+            Clock::time_point start = Clock::now();
+            sim.simulate();
+            double seconds = secondsSince(start);
+
+            // Every lane takes in and finishes each part, as the separate
+            // machines do, whatever the number of array events.
+            double laneSteps = 2.0 * parts * scale;
+
+            std::cout << std::left << std::setw(12) << topology << std::right << std::setw(10) << scale
+                << std::setw(12) << sim.getEventCount() << std::setw(16) << std::fixed << std::setprecision(0)
+                << laneSteps / seconds << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+}
+
+#ifdef DEVS_COROUTINES
+// A chain of Machines against the same chain written as processes.
+static void benchmarkProcess(std::size_t maxScale) {
+    const int parts = 4;
+
+    std::cout << "Machine chain as processes, " << parts << " parts per run" << std::endl;
+    std::cout << std::left << std::setw(12) << "models" << std::right << std::setw(10) << "machines"
+        << std::setw(12) << "events" << std::setw(16) << "events/s" << std::endl;
+
+    for (std::size_t scale = 100; scale <= maxScale; scale *= 10) {
+        for (bool isProcess : { false, true }) {
+            Simulator sim;
+            std::vector<std::unique_ptr<SimulationModel>> machines;
+
+            for (std::size_t i = 0; i < scale; i++) {
+                int timeToProcess = 1 + static_cast<int>(i % 3);
+                machines.emplace_back(isProcess ? static_cast<SimulationModel*>(new MachineProcess(timeToProcess)) : new Machine(timeToProcess));
+                sim.addModel(machines.back().get());
+
+                if (i > 0) {
+                    sim.addCoupling(machines[i - 1].get(), machines[i].get());
+                }
+            }
+
+            sim.routeInputTo(machines.front().get());
+            sim.addInput(parts, 0.0);
+
+            Clock::time_point start = Clock::now();
+            sim.simulate();
+            double seconds = secondsSince(start);
+
+            std::cout << std::left << std::setw(12) << (isProcess ? "process" : "machine") << std::right << std::setw(10) << scale
+                << std::setw(12) << sim.getEventCount() << std::setw(16) << std::fixed << std::setprecision(0)
+                << sim.getEventCount() / seconds << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+}
+#endif
+
+// The example's press and drill, composed at compile time and at run time.
+static void benchmarkStatic(std::size_t maxScale) {
+    std::cout << "Press -> Drill, one input every 1.5" << std::endl;
+    std::cout << std::left << std::setw(12) << "simulator" << std::right << std::setw(10) << "inputs"
+        << std::setw(12) << "events" << std::setw(16) << "events/s" << std::endl;
+
+    for (std::size_t scale = 100; scale <= maxScale; scale *= 10) {
+        StaticSimulator<Models<Press, Drill>, Couplings<Input<0>, Connect<0, 1>>> composed;
+
+        Simulator sim;
+        Press press;
+        Drill drill;
+
+        sim.addModel(&press);
+        sim.addModel(&drill);
+        sim.addCoupling(&press, &drill);
+        sim.routeInputTo(&press);
+
+        for (std::size_t i = 0; i < scale; i++) {
+            composed.addInput(1 + static_cast<int>(i % 3), i * 1.5);
+            sim.addInput(1 + static_cast<int>(i % 3), i * 1.5);
+        }
+
+        Clock::time_point start = Clock::now();
+        composed.simulate();
+        double composedSeconds = secondsSince(start);
+
+        start = Clock::now();
+        sim.simulate();
+        double seconds = secondsSince(start);
+
+        std::cout << std::left << std::setw(12) << "static" << std::right << std::setw(10) << scale
+            << std::setw(12) << composed.getEventCount() << std::setw(16) << std::fixed << std::setprecision(0)
+            << composed.getEventCount() / composedSeconds << std::endl;
+        std::cout << std::left << std::setw(12) << "dynamic" << std::right << std::setw(10) << scale
+            << std::setw(12) << sim.getEventCount() << std::setw(16) << std::fixed << std::setprecision(0)
+            << sim.getEventCount() / seconds << std::endl;
+    }
+
+    std::cout << std::endl;
+}
+
+// Exponential draws from the standard generator and from a model's random
+// stream, one at a time and a thousand to a call.
+static void benchmarkRandom(std::size_t maxScale) {
+    const std::size_t batch = 1000;
+
+    std::cout << "Exponential samples" << std::endl;
+    std::cout << std::left << std::setw(12) << "generator" << std::right << std::setw(10) << "samples"
+        << std::setw(12) << "mean" << std::setw(16) << "samples/s" << std::endl;
+
+    for (std::size_t scale = 1000; scale <= maxScale * 10; scale *= 10) {
+        for (const char* generator : { "mt19937_64", "stream", "stream x1000" }) {
+            std::mt19937_64 random(scale);
+            std::exponential_distribution<double> exponential(1.0);
+            RandomStream stream;
+            std::vector<double> values(batch);
+            double sum = 0.0;
+
+            Clock::time_point start = Clock::now();
+
+            if (std::string(generator) == "mt19937_64") {
+                for (std::size_t i = 0; i < scale; i++) {
+                    sum += exponential(random);
+                }
+            }
+            else if (std::string(generator) == "stream") {
+                for (std::size_t i = 0; i < scale; i++) {
+                    sum += stream.exponential(1.0);
+                }
+            }
+            else {
+                for (std::size_t i = 0; i < scale; i += batch) {
+                    stream.exponentials(values.data(), batch, 1.0);
+
+                    for (double value : values) {
+                        sum += value;
+                    }
+                }
+            }
+
+            double seconds = secondsSince(start);
+
+            std::cout << std::left << std::setw(12) << generator << std::right << std::setw(10) << scale
+                << std::setw(12) << std::fixed << std::setprecision(4) << sum / scale << std::setw(16) << std::setprecision(0)
+                << scale / seconds << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+}
+
+// Usage: Benchmark [largest scale], 10^6 by default.
+int main(int argc, char* argv[]) {
+    std::size_t maxScale = argc > 1 ? static_cast<std::size_t>(std::stoull(argv[1])) : 1000000;
+
+    benchmarkQueue(maxScale);
+    benchmarkSimulator(maxScale);
+    benchmarkArray(maxScale);
+#ifdef DEVS_COROUTINES
+    benchmarkProcess(maxScale);
+#endif
+    benchmarkStatic(maxScale);
+    benchmarkRandom(maxScale);
+
+    return 0;
+}
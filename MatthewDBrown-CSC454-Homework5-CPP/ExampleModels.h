@@ -0,0 +1,272 @@
+#pragma once
+
+#include "Framework.h"
+
+//---------------------------------------------------
+// EXAMPLE MODEL
+//---------------------------------------------------
+
+class Machine : public SimulationModel {
+private:
+    int parts;
+    double nextInternalEvent;
+    const int timeToProcess;
+
+public:
+    Machine(int timeToProcess) : timeToProcess(timeToProcess), parts(0), nextInternalEvent(std::numeric_limits<double>::infinity()) {}
+
+    Message lambda() override {
+        return 1;
+    }
+
+    void deltaInt(double timeElapsed) override {
+        parts--;
+
+        if (parts > 0) {
+            nextInternalEvent = timeElapsed + timeToProcess;
+        }
+        else {
+            nextInternalEvent = std::numeric_limits<double>::infinity();
+        }
+    }
+
+    void deltaExt(const Message& input, double timeElapsed) override {
+        int originalParts = parts;
+
+        parts += static_cast<int>(input.asInteger());
+
+        if (parts == 0) {
+            nextInternalEvent = std::numeric_limits<double>::infinity();
+        }
+        else if (originalParts == 0 && parts > 0) {
+            nextInternalEvent = timeElapsed + timeToProcess;
+        }
+        else {
+            keepTimeAdvance();
+        }
+    }
+
+    void deltaCon(const Message& input, double timeElapsed) override {
+        int originalParts = parts;
+
+        parts += static_cast<int>(input.asInteger()) - 1;
+
+        if (parts == 0) {
+            nextInternalEvent = std::numeric_limits<double>::infinity();
+        }
+        else if (originalParts == 0 && parts > 0) {
+            nextInternalEvent = timeElapsed + timeToProcess;
+        }
+    }
+
+    double getNextInternalEvent() override {
+        return nextInternalEvent;
+    }
+
+    // A part taken in at t is not done before t + timeToProcess.
+    double lookahead() const override {
+        return timeToProcess;
+    }
+
+    void saveState(StateBuffer& state) const override {
+        state.write(parts);
+        state.write(nextInternalEvent);
+    }
+
+    void restoreState(StateBuffer& state) override {
+        state.read(parts);
+        state.read(nextInternalEvent);
+    }
+};
+
+class Drill : public Machine {
+public:
+    Drill() : Machine(2) {}
+
+    Message lambda() override {
+        return "1 part completed";
+    }
+};
+
+class Press : public Machine {
+public:
+    Press() : Machine(1) {}
+};
+
+// A machine taking a fixed setup time plus an exponentially distributed
+// run for each part, drawn from its own random stream as the part starts.
+class RandomMachine : public SimulationModel {
+private:
+    int parts;
+    double nextInternalEvent;
+    const double setupTime;
+    const double meanRunTime;
+
+    void startPart(double r) {
+        nextInternalEvent = r + setupTime + getRandom().exponential(meanRunTime);
+    }
+
+public:
+    RandomMachine(double setupTime, double meanRunTime)
+        : parts(0), nextInternalEvent(std::numeric_limits<double>::infinity()), setupTime(setupTime), meanRunTime(meanRunTime) {}
+
+    Message lambda() override {
+        return 1;
+    }
+
+    void deltaInt(double timeElapsed) override {
+        parts--;
+
+        if (parts > 0) {
+            startPart(timeElapsed);
+        }
+        else {
+            nextInternalEvent = std::numeric_limits<double>::infinity();
+        }
+    }
+
+    void deltaExt(const Message& input, double timeElapsed) override {
+        int originalParts = parts;
+
+        parts += static_cast<int>(input.asInteger());
+
+        if (parts == 0) {
+            nextInternalEvent = std::numeric_limits<double>::infinity();
+        }
+        else if (originalParts == 0 && parts > 0) {
+            startPart(timeElapsed);
+        }
+        else {
+            keepTimeAdvance();
+        }
+    }
+
+    void deltaCon(const Message& input, double timeElapsed) override {
+        deltaInt(timeElapsed);
+        deltaExt(input, timeElapsed);
+    }
+
+    double getNextInternalEvent() override {
+        return nextInternalEvent;
+    }
+
+    // A part taken in at t is not done before t + setupTime.
+    double lookahead() const override {
+        return setupTime;
+    }
+
+    void saveState(StateBuffer& state) const override {
+        state.write(parts);
+        state.write(nextInternalEvent);
+    }
+
+    void restoreState(StateBuffer& state) override {
+        state.read(parts);
+        state.read(nextInternalEvent);
+    }
+};
+
+// Machines with their state in columns: lane i holds parts[i],
+// timesToProcess[i] and nextInternalEvents[i] of one machine.
+class MachineArray : public ModelArray {
+private:
+    std::vector<int> parts;
+    std::vector<int> timesToProcess;
+
+    // As Machine::deltaExt(), lane by lane.
+    void addParts(Lane lane, int count, double timeElapsed) {
+        int originalParts = parts[lane];
+
+        parts[lane] += count;
+
+        if (parts[lane] == 0) {
+            nextInternalEvents[lane] = std::numeric_limits<double>::infinity();
+        }
+        else if (originalParts == 0 && parts[lane] > 0) {
+            nextInternalEvents[lane] = timeElapsed + timesToProcess[lane];
+        }
+    }
+
+protected:
+    void lambdaLanes(const std::vector<Lane>& lanes, MessageBag& outputs) override {
+        for (Lane lane : lanes) {
+            outputs.push_back(Message(1).setPort(static_cast<PortId>(lane)));
+        }
+    }
+
+    // Branch-free over the columns, so the compiler can vectorize it.
+    void deltaIntLanes(const std::vector<Lane>& lanes, double timeElapsed) override {
+        const double infinity = std::numeric_limits<double>::infinity();
+        const Lane* lane = lanes.data();
+        int* partsOf = parts.data();
+        const int* timeOf = timesToProcess.data();
+        double* nextOf = nextInternalEvents.data();
+
+        for (std::size_t i = 0; i < lanes.size(); i++) {
+            int remaining = --partsOf[lane[i]];
+            nextOf[lane[i]] = remaining > 0 ? timeElapsed + timeOf[lane[i]] : infinity;
+        }
+    }
+
+    void deltaExtLane(Lane lane, const Message& input, double timeElapsed) override {
+        addParts(lane, static_cast<int>(input.asInteger()), timeElapsed);
+    }
+
+    void deltaConLane(Lane lane, const Message& input, double timeElapsed) override {
+        addParts(lane, static_cast<int>(input.asInteger()) - 1, timeElapsed);
+    }
+
+    void saveColumns(StateBuffer& state) const override {
+        for (int count : parts) {
+            state.write(count);
+        }
+    }
+
+    void restoreColumns(StateBuffer& state) override {
+        for (int& count : parts) {
+            state.read(count);
+        }
+    }
+
+public:
+    MachineArray(std::size_t count, int timeToProcess) : ModelArray(count), parts(count, 0), timesToProcess(count, timeToProcess) {}
+
+    int getParts(Lane lane) const {
+        return parts[lane];
+    }
+
+    double lookahead() const override {
+        return timesToProcess.empty() ? 0.0 : *std::min_element(timesToProcess.begin(), timesToProcess.end());
+    }
+};
+
+#ifdef DEVS_COROUTINES
+// The Machine written as a process: wait for parts, then work through them
+// one at a time, passing each on as it is done.
+class MachineProcess : public ProcessModel {
+private:
+    const int timeToProcess;
+
+protected:
+    Process run() override {
+        int parts = 0;
+
+        while (true) {
+            while (parts <= 0 || hasInput()) {
+                parts += static_cast<int>((co_await receive()).asInteger());
+            }
+
+            co_await hold(timeToProcess);
+            send(1);
+            parts--;
+        }
+    }
+
+public:
+    MachineProcess(int timeToProcess) : timeToProcess(timeToProcess) {}
+
+    double lookahead() const override {
+        return timeToProcess;
+    }
+};
+#endif
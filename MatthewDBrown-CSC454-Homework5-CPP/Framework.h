@@ -0,0 +1,7062 @@
+#pragma once
+
+#include <iostream>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <limits>
+#include <cmath>
+#include <tuple>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include <type_traits>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdio>
+#include <string_view>
+#include <fstream>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <exception>
+#include <utility>
+
+// Process models need C++20 coroutines.
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define DEVS_COROUTINES
+#endif
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//---------------------------------------------------
+// FRAMEWORK
+//---------------------------------------------------
+
+// Representations of the real part r of a Time. Each maps r to an unsigned
+// key that orders the same way, so times compare as plain integers.
+// FloatingPoint keeps every double exactly. FixedPoint<N> rounds r to
+// int64 ticks of 1/N, so durations summed by models can never drift
+// apart: times that round to the same tick are simultaneous.
+struct FloatingPoint {
+    static const std::uint64_t SIGN = std::uint64_t(1) << 63;
+
+    static std::uint64_t toKey(double r) {
+        std::uint64_t bits;
+        r = r == 0.0 ? 0.0 : r;
+        std::memcpy(&bits, &r, sizeof(bits));
+
+        return (bits & SIGN) != 0 ? ~bits : bits | SIGN;
+    }
+
+    static double toReal(std::uint64_t key) {
+        std::uint64_t bits = (key & SIGN) != 0 ? key & ~SIGN : ~key;
+        double r;
+        std::memcpy(&r, &bits, sizeof(r));
+
+        return r;
+    }
+};
+
+// Times beyond the range of the ticks are infinite.
+template <std::int64_t TicksPerUnit>
+struct FixedPoint {
+    static_assert(TicksPerUnit > 0, "a tick is a positive fraction of a unit");
+
+    static std::uint64_t toKey(double r) {
+        const double limit = static_cast<double>(std::numeric_limits<std::int64_t>::max()) / TicksPerUnit;
+        std::int64_t ticks;
+
+        if (!(r < limit)) {
+            ticks = std::numeric_limits<std::int64_t>::max();
+        }
+        else if (!(r > -limit)) {
+            ticks = std::numeric_limits<std::int64_t>::min();
+        }
+        else {
+            ticks = std::llround(r * TicksPerUnit);
+        }
+
+        return static_cast<std::uint64_t>(ticks) ^ FloatingPoint::SIGN;
+    }
+
+    static double toReal(std::uint64_t key) {
+        std::int64_t ticks = static_cast<std::int64_t>(key ^ FloatingPoint::SIGN);
+
+        if (ticks == std::numeric_limits<std::int64_t>::max()) {
+            return std::numeric_limits<double>::infinity();
+        }
+
+        if (ticks == std::numeric_limits<std::int64_t>::min()) {
+            return -std::numeric_limits<double>::infinity();
+        }
+
+        return static_cast<double>(ticks) / TicksPerUnit;
+    }
+};
+
+// Super-dense time (r, c): c orders the micro-steps taken at a single r.
+template <typename Representation>
+class BasicTime {
+private:
+    std::uint64_t r;
+    std::uint32_t c;
+
+public:
+    BasicTime(double r = 0.0, int c = 0) : r(Representation::toKey(r)), c(static_cast<std::uint32_t>(c)) {}
+
+    double getR() const {
+        return Representation::toReal(r);
+    }
+
+    int getC() const {
+        return static_cast<int>(c);
+    }
+
+    int compareTo(const BasicTime& other) const {
+        if (r == other.r) {
+            return getC() - other.getC();
+        }
+
+        return r < other.r ? -1 : 1;
+    }
+
+    // r and c packed into one word, on compilers that have one wide enough.
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 getKey() const {
+        return static_cast<unsigned __int128>(r) << 32 | c;
+    }
+
+    bool operator<(const BasicTime& other) const {
+        return getKey() < other.getKey();
+    }
+#else
+    bool operator<(const BasicTime& other) const {
+        return r < other.r || (r == other.r && c < other.c);
+    }
+#endif
+
+    bool operator==(const BasicTime& other) const {
+        return r == other.r && c == other.c;
+    }
+
+    // Whether both times are at the same r, whatever their micro-steps.
+    bool isSimultaneousWith(const BasicTime& other) const {
+        return r == other.r;
+    }
+
+    std::size_t hashCode() const {
+        return std::hash<std::uint64_t>{}(r) ^ (std::hash<std::uint32_t>{}(c) << 1);
+    }
+};
+
+// Builds defining DEVS_TICKS_PER_UNIT run on fixed-point time.
+#ifdef DEVS_TICKS_PER_UNIT
+typedef BasicTime<FixedPoint<DEVS_TICKS_PER_UNIT>> Time;
+#else
+typedef BasicTime<FloatingPoint> Time;
+#endif
+
+// Bytes a model saves its state to and restores it from. Values are read
+// back in the order they were written; besides strings, only trivially
+// copyable ones fit.
+class StateBuffer {
+private:
+    std::vector<unsigned char> bytes;
+    std::size_t cursor = 0;
+
+    void require(std::size_t count) const {
+        if (count > bytes.size() - cursor) {
+            throw std::out_of_range("read past the end of the state");
+        }
+    }
+
+public:
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "state must be trivially copyable");
+
+        std::size_t offset = bytes.size();
+        bytes.resize(offset + sizeof(T));
+        std::memcpy(bytes.data() + offset, &value, sizeof(T));
+    }
+
+    template <typename T>
+    void read(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "state must be trivially copyable");
+
+        require(sizeof(T));
+        std::memcpy(&value, bytes.data() + cursor, sizeof(T));
+        cursor += sizeof(T);
+    }
+
+    void write(const std::string& value) {
+        write(static_cast<std::uint64_t>(value.size()));
+
+        std::size_t offset = bytes.size();
+        bytes.resize(offset + value.size());
+        std::memcpy(bytes.data() + offset, value.data(), value.size());
+    }
+
+    void read(std::string& value) {
+        std::uint64_t size;
+        read(size);
+
+        require(static_cast<std::size_t>(size));
+        value.assign(reinterpret_cast<const char*>(bytes.data() + cursor), static_cast<std::size_t>(size));
+        cursor += static_cast<std::size_t>(size);
+    }
+
+    // Replaces the contents, e.g. with bytes read from a file, and reads
+    // from the start.
+    void load(const unsigned char* data, std::size_t size) {
+        bytes.assign(data, data + size);
+        cursor = 0;
+    }
+
+    const unsigned char* data() const {
+        return bytes.data();
+    }
+
+    std::size_t position() const {
+        return cursor;
+    }
+
+    void seek(std::size_t position) {
+        cursor = position;
+    }
+
+    // Drops everything from size on.
+    void truncate(std::size_t size) {
+        bytes.resize(size);
+    }
+
+    // Drops the first count bytes; later positions move down by count.
+    void discardFront(std::size_t count) {
+        bytes.erase(bytes.begin(), bytes.begin() + count);
+    }
+
+    std::size_t size() const {
+        return bytes.size();
+    }
+};
+
+typedef std::uint16_t PortId;
+
+// Value passed from one model's lambda() to another model's deltaExt().
+// Integers, reals and small trivially copyable structs are held inline, so
+// they travel between models without allocating or parsing; text is kept
+// for models that still speak in strings. The port names the output port a
+// message leaves on and, once routed, the input port it arrives at.
+class Message {
+public:
+    enum class Type : unsigned char {
+        Empty,
+        Integer,
+        Real,
+        Struct,
+        Text
+    };
+
+    static const std::size_t INLINE_SIZE = 16;
+
+private:
+    Type type;
+    unsigned char size;
+    PortId port = 0;
+
+    union {
+        std::int64_t integer;
+        double real;
+        alignas(std::max_align_t) unsigned char bytes[INLINE_SIZE];
+    };
+
+    std::string text;
+
+public:
+    Message() : type(Type::Empty), size(0), integer(0) {}
+
+    // One constructor per integer type, so std::int64_t, std::size_t and the
+    // like are never ambiguous; unsigned values above INT64_MAX wrap.
+    Message(int value) : type(Type::Integer), size(0), integer(value) {}
+
+    Message(long value) : type(Type::Integer), size(0), integer(value) {}
+
+    Message(long long value) : type(Type::Integer), size(0), integer(value) {}
+
+    Message(unsigned int value) : type(Type::Integer), size(0), integer(value) {}
+
+    Message(unsigned long value) : type(Type::Integer), size(0), integer(static_cast<std::int64_t>(value)) {}
+
+    Message(unsigned long long value) : type(Type::Integer), size(0), integer(static_cast<std::int64_t>(value)) {}
+
+    Message(double value) : type(Type::Real), size(0), real(value) {}
+
+    Message(const char* value) : type(Type::Text), size(0), integer(0), text(value) {}
+
+    Message(const std::string& value) : type(Type::Text), size(0), integer(0), text(value) {}
+
+    Message(std::string&& value) : type(Type::Text), size(0), integer(0), text(std::move(value)) {}
+
+    template <typename T>
+    static Message of(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "struct payloads are copied bytewise");
+        static_assert(sizeof(T) <= INLINE_SIZE, "struct payload does not fit inline");
+
+        Message message;
+        message.type = Type::Struct;
+        message.size = sizeof(T);
+        std::memcpy(message.bytes, &value, sizeof(T));
+
+        return message;
+    }
+
+    Type getType() const {
+        return type;
+    }
+
+    PortId getPort() const {
+        return port;
+    }
+
+    Message& setPort(PortId port) {
+        this->port = port;
+        return *this;
+    }
+
+    bool isEmpty() const {
+        return type == Type::Empty;
+    }
+
+    // Text is accepted as well, so string inputs still reach typed models.
+    std::int64_t asInteger() const {
+        switch (type) {
+        case Type::Integer:
+            return integer;
+        case Type::Real:
+            return static_cast<std::int64_t>(real);
+        case Type::Text:
+            return std::stoll(text);
+        default:
+            return 0;
+        }
+    }
+
+    double asReal() const {
+        switch (type) {
+        case Type::Integer:
+            return static_cast<double>(integer);
+        case Type::Real:
+            return real;
+        case Type::Text:
+            return std::stod(text);
+        default:
+            return 0.0;
+        }
+    }
+
+    template <typename T>
+    T as() const {
+        static_assert(std::is_trivially_copyable<T>::value, "struct payloads are copied bytewise");
+        static_assert(sizeof(T) <= INLINE_SIZE, "struct payload does not fit inline");
+
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+
+        return value;
+    }
+
+    const std::string& getText() const {
+        return text;
+    }
+
+    // The inline payload as raw bytes, and the size of a struct payload;
+    // binary traces store these and rebuild the message from them.
+    const unsigned char* getBytes() const {
+        return bytes;
+    }
+
+    std::size_t getSize() const {
+        return size;
+    }
+
+    void saveTo(StateBuffer& state) const {
+        state.write(type);
+        state.write(port);
+        state.write(size);
+        state.write(bytes);
+
+        if (type == Type::Text) {
+            state.write(text);
+        }
+    }
+
+    static Message loadFrom(StateBuffer& state) {
+        Message message;
+        state.read(message.type);
+        state.read(message.port);
+        state.read(message.size);
+        state.read(message.bytes);
+
+        if (message.type == Type::Text) {
+            state.read(message.text);
+        }
+
+        return message;
+    }
+
+    static Message fromBytes(Type type, const unsigned char* data, std::size_t size) {
+        Message message;
+        message.type = type;
+        message.size = static_cast<unsigned char>(size);
+        std::memcpy(message.bytes, data, INLINE_SIZE);
+
+        return message;
+    }
+
+    std::string toString() const {
+        switch (type) {
+        case Type::Integer:
+            return std::to_string(integer);
+        case Type::Real: {
+            std::ostringstream out;
+            out << real;
+            return out.str();
+        }
+        case Type::Struct:
+            return "<" + std::to_string(size) + " bytes>";
+        case Type::Text:
+            return text;
+        default:
+            return "";
+        }
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const Message& message) {
+        switch (message.type) {
+        case Type::Integer:
+            return out << message.integer;
+        case Type::Real:
+            return out << message.real;
+        case Type::Text:
+            return out << message.text;
+        default:
+            return out << message.toString();
+        }
+    }
+};
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3"): each block of random bits is a pure function of a 64-bit key and a
+// 128-bit counter, so streams share nothing and rolling one back is just
+// resetting its counter.
+class Philox {
+private:
+    static constexpr std::uint32_t M0 = 0xD2511F53;
+    static constexpr std::uint32_t M1 = 0xCD9E8D57;
+    static constexpr std::uint32_t W0 = 0x9E3779B9;
+    static constexpr std::uint32_t W1 = 0xBB67AE85;
+
+public:
+    // Blocks for the counters (first, c1, c2, c3) to (first + count - 1,
+    // c1, c2, c3), as two 64-bit words each. The blocks are independent,
+    // so the loop vectorizes.
+    static void generate(std::uint64_t key, std::uint32_t first, std::uint32_t c1, std::uint32_t c2, std::uint32_t c3,
+        std::uint64_t* out, std::size_t count) {
+        for (std::size_t i = 0; i < count; i++) {
+            std::uint32_t x0 = first + static_cast<std::uint32_t>(i);
+            std::uint32_t x1 = c1;
+            std::uint32_t x2 = c2;
+            std::uint32_t x3 = c3;
+            std::uint32_t k0 = static_cast<std::uint32_t>(key);
+            std::uint32_t k1 = static_cast<std::uint32_t>(key >> 32);
+
+            for (int round = 0; round < 10; round++) {
+                std::uint64_t p0 = static_cast<std::uint64_t>(M0) * x0;
+                std::uint64_t p1 = static_cast<std::uint64_t>(M1) * x2;
+
+                x0 = static_cast<std::uint32_t>(p1 >> 32) ^ x1 ^ k0;
+                x1 = static_cast<std::uint32_t>(p1);
+                x2 = static_cast<std::uint32_t>(p0 >> 32) ^ x3 ^ k1;
+                x3 = static_cast<std::uint32_t>(p0);
+                k0 += W0;
+                k1 += W1;
+            }
+
+            out[2 * i] = static_cast<std::uint64_t>(x1) << 32 | x0;
+            out[2 * i + 1] = static_cast<std::uint64_t>(x3) << 32 | x2;
+        }
+    }
+
+    // The top 53 bits as a double in (0, 1], safe to take the log of.
+    static double toUniform(std::uint64_t bits) {
+        return static_cast<double>((bits >> 11) + 1) * 0x1p-53;
+    }
+};
+
+// A model's random numbers. The simulator starts a new call before every
+// lambda and transition it runs, and the numbers a call draws depend only
+// on the seed, the stream and how many calls came before, never on thread,
+// engine or schedule. Numbers drawn outside those calls, e.g. in
+// getNextInternalEvent(), are not reproducible.
+class RandomStream {
+    friend class SimulationModel;
+    friend class Simulator;
+    friend class OptimisticSimulator;
+    template <typename, typename> friend class StaticSimulator;
+
+private:
+    static constexpr std::size_t CHUNK = 64;
+    static constexpr double TWO_PI = 6.283185307179586;
+
+    std::uint64_t seed = 0;
+    std::uint32_t stream = 0;
+    bool isSet = false;
+
+    // Counter words 1 to 3 are the stream and the call; word 0 is the block
+    // within the call, two draws to a block. Only the low 32 bits of the
+    // block index reach the counter, so a call drawing more than 2^33
+    // numbers starts over.
+    std::uint64_t call = 0;
+    std::uint64_t draw = 0;
+
+    // The block the last single draw came from, whose other half serves the
+    // next one.
+    std::uint64_t cached[2];
+    std::uint64_t cachedCall = 0;
+    std::uint64_t cachedBlock = std::numeric_limits<std::uint64_t>::max();
+
+    void beginCall() {
+        call++;
+        draw = 0;
+    }
+
+    void generate(std::uint64_t* out, std::size_t blocks) {
+        Philox::generate(seed, static_cast<std::uint32_t>(draw / 2), stream, static_cast<std::uint32_t>(call),
+            static_cast<std::uint32_t>(call >> 32), out, blocks);
+        draw += 2 * blocks;
+    }
+
+public:
+    void setStream(std::uint64_t seed, std::uint32_t stream) {
+        this->seed = seed;
+        this->stream = stream;
+        isSet = true;
+        cachedBlock = std::numeric_limits<std::uint64_t>::max();
+    }
+
+    double uniform() {
+        if (cachedCall != call || cachedBlock != draw / 2) {
+            Philox::generate(seed, static_cast<std::uint32_t>(draw / 2), stream, static_cast<std::uint32_t>(call),
+                static_cast<std::uint32_t>(call >> 32), cached, 1);
+            cachedCall = call;
+            cachedBlock = draw / 2;
+        }
+
+        return Philox::toUniform(cached[draw++ % 2]);
+    }
+
+    double exponential(double mean) {
+        return -mean * std::log(uniform());
+    }
+
+    double normal(double mean, double deviation) {
+        double radius = std::sqrt(-2.0 * std::log(uniform()));
+
+        return mean + deviation * radius * std::cos(TWO_PI * uniform());
+    }
+
+    double lognormal(double mu, double sigma) {
+        return std::exp(normal(mu, sigma));
+    }
+
+    // The array forms start on a fresh block, generate in chunks and
+    // transform in separate loops, for models drawing many numbers a call.
+    void uniforms(double* values, std::size_t count) {
+        std::uint64_t bits[2 * CHUNK];
+        draw += draw % 2;
+
+        for (std::size_t done = 0; done < count; done += 2 * CHUNK) {
+            std::size_t n = std::min(count - done, 2 * CHUNK);
+            generate(bits, (n + 1) / 2);
+
+            for (std::size_t i = 0; i < n; i++) {
+                values[done + i] = Philox::toUniform(bits[i]);
+            }
+        }
+    }
+
+    void exponentials(double* values, std::size_t count, double mean) {
+        uniforms(values, count);
+
+        for (std::size_t i = 0; i < count; i++) {
+            values[i] = -mean * std::log(values[i]);
+        }
+    }
+
+    // Box-Muller in pairs, each pair of uniforms giving two normals.
+    void normals(double* values, std::size_t count, double mean, double deviation) {
+        std::size_t pairs = count / 2;
+        uniforms(values, 2 * pairs);
+
+        for (std::size_t i = 0; i < pairs; i++) {
+            double radius = deviation * std::sqrt(-2.0 * std::log(values[2 * i]));
+            double angle = TWO_PI * values[2 * i + 1];
+
+            values[2 * i] = mean + radius * std::cos(angle);
+            values[2 * i + 1] = mean + radius * std::sin(angle);
+        }
+
+        if (count % 2 != 0) {
+            values[count - 1] = normal(mean, deviation);
+        }
+    }
+
+    void lognormals(double* values, std::size_t count, double mu, double sigma) {
+        normals(values, count, mu, sigma);
+
+        for (std::size_t i = 0; i < count; i++) {
+            values[i] = std::exp(values[i]);
+        }
+    }
+};
+
+typedef std::size_t EventHandle;
+
+const EventHandle NO_EVENT = std::numeric_limits<EventHandle>::max();
+
+const std::size_t NO_MODEL = std::numeric_limits<std::size_t>::max();
+
+typedef std::vector<Message> MessageBag;
+
+class SimulationModel {
+    friend class CoupledModel;
+    friend class EventQueue;
+    friend class Simulator;
+    friend class OptimisticSimulator;
+    template <typename, typename> friend class StaticSimulator;
+
+private:
+    // Maintained by the EventQueue: the model's single pending internal (or
+    // confluent) event, and its pending external events.
+    EventHandle internalEvent = NO_EVENT;
+    std::vector<EventHandle> externalEvents;
+
+    // The r of internalEvent, infinite while the model is passive. It is NaN
+    // once the event has been taken off the queue, as the model then has to
+    // be asked for its next one.
+    double scheduledTime = std::numeric_limits<double>::infinity();
+
+    // Maintained by the Simulator through a step: whether every deltaExt
+    // called keepTimeAdvance(), and whether the model has been rescheduled.
+    bool isTimeAdvanceKept = false;
+    bool keepsTimeAdvance = true;
+    bool isRescheduled = false;
+
+    // Dense index assigned by the Simulator the model is added to.
+    std::size_t id = NO_MODEL;
+
+    std::vector<std::string> inputPorts;
+    std::vector<std::string> outputPorts;
+
+    // Its stream is the model's id in the first simulator it is added to,
+    // unless set beforehand.
+    RandomStream randomStream;
+
+    static PortId findPort(const std::vector<std::string>& ports, const std::string& name, const char* defaultName) {
+        if (ports.empty() && name == defaultName) {
+            return 0;
+        }
+
+        auto found = std::find(ports.begin(), ports.end(), name);
+
+        if (found == ports.end()) {
+            throw std::invalid_argument("unknown port: " + name);
+        }
+
+        return static_cast<PortId>(found - ports.begin());
+    }
+
+protected:
+    // Until a model declares ports of its own it has a single input port
+    // "in" and a single output port "out".
+    PortId addInputPort(const std::string& name) {
+        inputPorts.push_back(name);
+        return static_cast<PortId>(inputPorts.size() - 1);
+    }
+
+    PortId addOutputPort(const std::string& name) {
+        outputPorts.push_back(name);
+        return static_cast<PortId>(outputPorts.size() - 1);
+    }
+
+    // Called from deltaExt when the input leaves the next internal event
+    // where it was, so the simulator need not ask for it again.
+    void keepTimeAdvance() {
+        isTimeAdvanceKept = true;
+    }
+
+    RandomStream& getRandom() {
+        return randomStream;
+    }
+
+public:
+    // Models with the same seed and stream draw the same numbers; a seed per
+    // replication and a stream per model keep them all independent.
+    void setRandomStream(std::uint64_t seed, std::uint32_t stream) {
+        randomStream.setStream(seed, stream);
+    }
+
+    PortId getInputPort(const std::string& name) const {
+        return findPort(inputPorts, name, "in");
+    }
+
+    PortId getOutputPort(const std::string& name) const {
+        return findPort(outputPorts, name, "out");
+    }
+
+    // Single-output models override lambda(); models emitting on several
+    // ports at once override lambda(MessageBag&) instead.
+    virtual Message lambda() {
+        return Message();
+    }
+
+    virtual void lambda(MessageBag& outputs) {
+        Message output = lambda();
+
+        if (!output.isEmpty()) {
+            outputs.push_back(std::move(output));
+        }
+    }
+
+    virtual void deltaInt(double timeElapsed) = 0;
+    virtual void deltaExt(const Message& input, double timeElapsed) = 0;
+    virtual void deltaCon(const Message& input, double timeElapsed) = 0;
+
+    virtual double getNextInternalEvent() = 0;
+
+    // Least time between an input reaching the model and any output it
+    // causes. Logical processes use it to run ahead of their neighbours;
+    // zero promises nothing.
+    virtual double lookahead() const {
+        return 0.0;
+    }
+
+    // Everything the transitions change, for optimistic runs to roll the
+    // model back. Models without state of their own keep the defaults.
+    virtual void saveState(StateBuffer&) const {}
+    virtual void restoreState(StateBuffer&) {}
+
+    virtual ~SimulationModel() = default;
+};
+
+// Adapter for models written against strings: outputs are sent as text and
+// every input is handed over converted to its textual form.
+class StringSimulationModel : public SimulationModel {
+public:
+    virtual std::string lambdaString() = 0;
+    virtual void deltaExt(const std::string& input, double timeElapsed) = 0;
+    virtual void deltaCon(const std::string& input, double timeElapsed) = 0;
+
+    Message lambda() final {
+        std::string output = lambdaString();
+
+        return output.empty() ? Message() : Message(std::move(output));
+    }
+
+    void deltaExt(const Message& input, double timeElapsed) final {
+        deltaExt(input.getType() == Message::Type::Text ? input.getText() : input.toString(), timeElapsed);
+    }
+
+    void deltaCon(const Message& input, double timeElapsed) final {
+        deltaCon(input.getType() == Message::Type::Text ? input.getText() : input.toString(), timeElapsed);
+    }
+};
+
+// A composite of atomic and coupled sub-models, with couplings among them
+// and between them and its own ports; subclasses make reusable cells out of
+// models they own. A coupled model never runs. Simulator::addModel()
+// flattens it into its atomic models and direct routes between them, so
+// messages never pass through it. It must be complete when it is added.
+class CoupledModel {
+    friend class Simulator;
+
+private:
+    // A port of a sub-model, or of this model when both pointers are null.
+    struct Endpoint {
+        SimulationModel* atomic;
+        CoupledModel* coupled;
+        PortId port;
+    };
+
+    struct Link {
+        Endpoint from;
+        Endpoint to;
+    };
+
+    typedef std::vector<std::pair<SimulationModel*, PortId>> AtomicPorts;
+
+    std::vector<SimulationModel*> atomicModels;
+    std::vector<CoupledModel*> coupledModels;
+
+    std::vector<std::string> inputPorts;
+    std::vector<std::string> outputPorts;
+
+    // Couplings from this model's input ports, between sub-models and to
+    // this model's output ports.
+    std::vector<Link> inputLinks;
+    std::vector<Link> internalLinks;
+    std::vector<Link> outputLinks;
+
+    static Endpoint outputOf(SimulationModel* m, const std::string& port) {
+        return { m, nullptr, m->getOutputPort(port) };
+    }
+
+    static Endpoint outputOf(CoupledModel* m, const std::string& port) {
+        return { nullptr, m, m->getOutputPort(port) };
+    }
+
+    static Endpoint inputOf(SimulationModel* m, const std::string& port) {
+        return { m, nullptr, m->getInputPort(port) };
+    }
+
+    static Endpoint inputOf(CoupledModel* m, const std::string& port) {
+        return { nullptr, m, m->getInputPort(port) };
+    }
+
+    // The atomic input ports a message sent to endpoint ends up at.
+    static void collectDestinations(const Endpoint& endpoint, AtomicPorts& destinations) {
+        if (endpoint.atomic != nullptr) {
+            destinations.emplace_back(endpoint.atomic, endpoint.port);
+            return;
+        }
+
+        for (const Link& link : endpoint.coupled->inputLinks) {
+            if (link.from.port == endpoint.port) {
+                collectDestinations(link.to, destinations);
+            }
+        }
+    }
+
+    // The atomic output ports whose messages leave through endpoint.
+    static void collectSources(const Endpoint& endpoint, AtomicPorts& sources) {
+        if (endpoint.atomic != nullptr) {
+            sources.emplace_back(endpoint.atomic, endpoint.port);
+            return;
+        }
+
+        for (const Link& link : endpoint.coupled->outputLinks) {
+            if (link.to.port == endpoint.port) {
+                collectSources(link.from, sources);
+            }
+        }
+    }
+
+public:
+    // Until a coupled model declares ports of its own it has a single input
+    // port "in" and a single output port "out".
+    PortId addInputPort(const std::string& name) {
+        inputPorts.push_back(name);
+        return static_cast<PortId>(inputPorts.size() - 1);
+    }
+
+    PortId addOutputPort(const std::string& name) {
+        outputPorts.push_back(name);
+        return static_cast<PortId>(outputPorts.size() - 1);
+    }
+
+    PortId getInputPort(const std::string& name) const {
+        return SimulationModel::findPort(inputPorts, name, "in");
+    }
+
+    PortId getOutputPort(const std::string& name) const {
+        return SimulationModel::findPort(outputPorts, name, "out");
+    }
+
+    void addModel(SimulationModel* m) {
+        atomicModels.push_back(m);
+    }
+
+    void addModel(CoupledModel* m) {
+        coupledModels.push_back(m);
+    }
+
+    // Either side may be an atomic or a coupled sub-model.
+    template <typename From, typename To>
+    void addCoupling(From* m1, const std::string& outputPort, To* m2, const std::string& inputPort) {
+        internalLinks.push_back({ outputOf(m1, outputPort), inputOf(m2, inputPort) });
+    }
+
+    // Passes what arrives at an input port of this model on to a sub-model.
+    template <typename To>
+    void addInputCoupling(const std::string& inputPort, To* m, const std::string& port) {
+        inputLinks.push_back({ { nullptr, nullptr, getInputPort(inputPort) }, inputOf(m, port) });
+    }
+
+    // Sends the outputs of a sub-model's port out of an output port of this
+    // model.
+    template <typename From>
+    void addOutputCoupling(From* m, const std::string& port, const std::string& outputPort) {
+        outputLinks.push_back({ outputOf(m, port), { nullptr, nullptr, getOutputPort(outputPort) } });
+    }
+
+    virtual ~CoupledModel() = default;
+};
+
+// Many instances of one model kind run as a single atomic model, for
+// populations too large to keep as separate objects. The subclass keeps the
+// instances' state in columns, one array per state variable, indexed by
+// lane; lane i takes input on input port i and emits on output port i, so
+// an array has at most 65536 lanes. Transitions come to the subclass a
+// whole step at a time: all the lanes that are imminent together, then the
+// inputs of the step lane by lane. Each lane sees exactly the transitions
+// it would as a model of its own.
+class ModelArray : public SimulationModel {
+public:
+    typedef std::uint32_t Lane;
+
+private:
+    struct LaneInput {
+        Lane lane;
+        Message input;
+    };
+
+    // Pending internal events of the lanes as a min-heap. An entry is stale
+    // once its lane has moved on, and is dropped when it reaches the top.
+    std::vector<std::pair<double, Lane>> laneEvents;
+
+    // Lanes imminent in the current step, found by lambda(); marks[lane]
+    // is the step the lane was last imminent in.
+    std::vector<Lane> imminent;
+    std::vector<std::uint64_t> marks;
+    std::uint64_t step = 0;
+
+    std::vector<LaneInput> inputs;
+    bool hasInternal = false;
+    double stepTime = 0.0;
+
+    void pushLaneEvent(Lane lane) {
+        if (nextInternalEvents[lane] < std::numeric_limits<double>::infinity()) {
+            laneEvents.emplace_back(nextInternalEvents[lane], lane);
+            std::push_heap(laneEvents.begin(), laneEvents.end(), std::greater<std::pair<double, Lane>>());
+        }
+    }
+
+    void popLaneEvent() {
+        std::pop_heap(laneEvents.begin(), laneEvents.end(), std::greater<std::pair<double, Lane>>());
+        laneEvents.pop_back();
+    }
+
+    bool isStale(const std::pair<double, Lane>& entry) const {
+        return nextInternalEvents[entry.second] != entry.first;
+    }
+
+    // Runs the transitions of the step once all of them have been handed
+    // over: inputs to imminent lanes are confluent, and the other imminent
+    // lanes go through one deltaIntLanes().
+    void applyStep() {
+        for (const LaneInput& pending : inputs) {
+            if (marks[pending.lane] == step && hasInternal) {
+                deltaConLane(pending.lane, pending.input, stepTime);
+                marks[pending.lane] = 0;
+            }
+            else {
+                deltaExtLane(pending.lane, pending.input, stepTime);
+            }
+        }
+
+        if (hasInternal) {
+            imminent.erase(std::remove_if(imminent.begin(), imminent.end(), [this](Lane lane) { return marks[lane] != step; }), imminent.end());
+            deltaIntLanes(imminent, stepTime);
+
+            for (Lane lane : imminent) {
+                pushLaneEvent(lane);
+            }
+        }
+
+        for (const LaneInput& pending : inputs) {
+            pushLaneEvent(pending.lane);
+        }
+
+        imminent.clear();
+        inputs.clear();
+        hasInternal = false;
+    }
+
+protected:
+    // Column the subclass keeps up to date: each lane's next internal event.
+    std::vector<double> nextInternalEvents;
+
+    explicit ModelArray(std::size_t laneCount) : marks(laneCount, 0), nextInternalEvents(laneCount, std::numeric_limits<double>::infinity()) {
+        if (laneCount > static_cast<std::size_t>(std::numeric_limits<PortId>::max()) + 1) {
+            throw std::invalid_argument("a model array has at most one lane per port");
+        }
+    }
+
+    virtual void lambdaLanes(const std::vector<Lane>& lanes, MessageBag& outputs) = 0;
+    virtual void deltaIntLanes(const std::vector<Lane>& lanes, double timeElapsed) = 0;
+    virtual void deltaExtLane(Lane lane, const Message& input, double timeElapsed) = 0;
+    virtual void deltaConLane(Lane lane, const Message& input, double timeElapsed) = 0;
+
+    // The subclass's own columns, for saveState() and restoreState().
+    virtual void saveColumns(StateBuffer&) const {}
+    virtual void restoreColumns(StateBuffer&) {}
+
+public:
+    std::size_t getLaneCount() const {
+        return nextInternalEvents.size();
+    }
+
+    // Outputs must be on the port of the lane they come from.
+    void lambda(MessageBag& outputs) final {
+        double now = getNextInternalEvent();
+        Time time(now, 0);
+        step++;
+
+        while (!laneEvents.empty() && Time(laneEvents.front().first, 0).isSimultaneousWith(time)) {
+            std::pair<double, Lane> entry = laneEvents.front();
+            popLaneEvent();
+
+            if (!isStale(entry) && marks[entry.second] != step) {
+                marks[entry.second] = step;
+                imminent.push_back(entry.second);
+            }
+        }
+
+        lambdaLanes(imminent, outputs);
+    }
+
+    void deltaInt(double timeElapsed) final {
+        hasInternal = true;
+        stepTime = timeElapsed;
+    }
+
+    void deltaExt(const Message& input, double timeElapsed) final {
+        inputs.push_back({ input.getPort(), input });
+        stepTime = timeElapsed;
+    }
+
+    void deltaCon(const Message& input, double timeElapsed) final {
+        hasInternal = true;
+        deltaExt(input, timeElapsed);
+    }
+
+    // The simulator asks once every transition of the step has been
+    // delivered, which is when the step is run.
+    double getNextInternalEvent() final {
+        if (hasInternal || !inputs.empty()) {
+            applyStep();
+        }
+
+        while (!laneEvents.empty() && isStale(laneEvents.front())) {
+            popLaneEvent();
+        }
+
+        return laneEvents.empty() ? std::numeric_limits<double>::infinity() : laneEvents.front().first;
+    }
+
+    void saveState(StateBuffer& state) const final {
+        for (double nextInternalEvent : nextInternalEvents) {
+            state.write(nextInternalEvent);
+        }
+
+        saveColumns(state);
+    }
+
+    void restoreState(StateBuffer& state) final {
+        laneEvents.clear();
+
+        for (Lane lane = 0; lane < nextInternalEvents.size(); lane++) {
+            state.read(nextInternalEvents[lane]);
+            pushLaneEvent(lane);
+        }
+
+        restoreColumns(state);
+    }
+};
+
+#ifdef DEVS_COROUTINES
+// Coroutine frames of processes, recycled through per-thread free lists,
+// one for each 64-byte size class. Once a frame of a size has been freed,
+// starting another process of that size does not touch the heap. Frames
+// larger than the biggest class come from the heap as usual.
+class ProcessFramePool {
+private:
+    static const std::size_t GRANULE = 64;
+    static const std::size_t CLASSES = 32;
+
+    struct FreeLists {
+        std::vector<void*> frames[CLASSES];
+
+        ~FreeLists() {
+            for (std::vector<void*>& list : frames) {
+                for (void* frame : list) {
+                    ::operator delete(frame);
+                }
+            }
+        }
+    };
+
+    static FreeLists& freeLists() {
+        thread_local FreeLists lists;
+        return lists;
+    }
+
+    static std::size_t sizeClass(std::size_t size) {
+        return (size + GRANULE - 1) / GRANULE - 1;
+    }
+
+public:
+    static void* allocate(std::size_t size) {
+        std::size_t index = sizeClass(size);
+
+        if (index >= CLASSES) {
+            return ::operator new(size);
+        }
+
+        std::vector<void*>& list = freeLists().frames[index];
+
+        if (list.empty()) {
+            return ::operator new((index + 1) * GRANULE);
+        }
+
+        void* frame = list.back();
+        list.pop_back();
+
+        return frame;
+    }
+
+    static void release(void* frame, std::size_t size) {
+        std::size_t index = sizeClass(size);
+
+        if (index >= CLASSES) {
+            ::operator delete(frame);
+            return;
+        }
+
+        freeLists().frames[index].push_back(frame);
+    }
+};
+
+// The coroutine a ProcessModel runs. It starts suspended and is destroyed
+// with its model.
+class Process {
+public:
+    struct promise_type {
+        std::exception_ptr exception;
+
+        Process get_return_object() {
+            return Process(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_always final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            exception = std::current_exception();
+        }
+
+        static void* operator new(std::size_t size) {
+            return ProcessFramePool::allocate(size);
+        }
+
+        static void operator delete(void* frame, std::size_t size) {
+            ProcessFramePool::release(frame, size);
+        }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Process(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+public:
+    Process() = default;
+
+    Process(Process&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    Process& operator=(Process&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+
+            handle = std::exchange(other.handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~Process() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool isValid() const {
+        return static_cast<bool>(handle);
+    }
+
+    bool isDone() const {
+        return handle.done();
+    }
+
+    // Runs the process to its next suspension and rethrows whatever it
+    // threw.
+    void resume() {
+        handle.resume();
+
+        if (handle.done() && handle.promise().exception) {
+            std::rethrow_exception(handle.promise().exception);
+        }
+    }
+};
+
+// A model written as a process: run() is a coroutine that waits with
+// co_await hold(duration) and co_await receive(), and outputs with send().
+// The transitions resume it where it was suspended, on the simulator's own
+// thread, so a process costs one pooled frame and no thread of its own.
+// The process starts at time 0. Inputs arriving while it
+// holds wait in a mailbox for the next receive(), and leave the hold's end
+// where it was. Messages sent are output at the current time, in an
+// internal event taken as soon as the process suspends. A suspended
+// coroutine cannot be saved, so process models are not for optimistic runs
+// or checkpoints.
+class ProcessModel : public SimulationModel {
+private:
+    Process process;
+    double now = 0.0;
+
+    // A process not yet started is due at time 0, so that one beginning with
+    // hold() or send() runs without waiting for an input.
+    double wakeTime = 0.0;
+    bool isReceiving = false;
+
+    std::deque<Message> mailbox;
+    MessageBag outbox;
+
+    void resume(double r) {
+        now = r;
+
+        if (!process.isValid()) {
+            wakeTime = std::numeric_limits<double>::infinity();
+            process = run();
+        }
+
+        if (!process.isDone()) {
+            process.resume();
+        }
+    }
+
+protected:
+    struct Hold {
+        ProcessModel* model;
+        double duration;
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<>) noexcept {
+            model->wakeTime = model->now + duration;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    struct Receive {
+        ProcessModel* model;
+
+        bool await_ready() const noexcept {
+            return !model->mailbox.empty();
+        }
+
+        void await_suspend(std::coroutine_handle<>) noexcept {
+            model->isReceiving = true;
+        }
+
+        Message await_resume() {
+            Message input = std::move(model->mailbox.front());
+            model->mailbox.pop_front();
+
+            return input;
+        }
+    };
+
+    virtual Process run() = 0;
+
+    // Suspends the process for duration, which may be zero.
+    Hold hold(double duration) {
+        if (!(duration >= 0.0)) {
+            throw std::invalid_argument("a process cannot hold for a negative time");
+        }
+
+        return Hold{ this, duration };
+    }
+
+    // The next input, waiting for one if the mailbox is empty.
+    Receive receive() {
+        return Receive{ this };
+    }
+
+    bool hasInput() const {
+        return !mailbox.empty();
+    }
+
+    void send(Message output) {
+        outbox.push_back(std::move(output));
+    }
+
+    double getTime() const {
+        return now;
+    }
+
+public:
+    void lambda(MessageBag& outputs) final {
+        outputs.insert(outputs.end(), outbox.begin(), outbox.end());
+    }
+
+    void deltaInt(double r) final {
+        outbox.clear();
+
+        if (wakeTime <= r) {
+            wakeTime = std::numeric_limits<double>::infinity();
+            resume(r);
+        }
+    }
+
+    void deltaExt(const Message& input, double r) final {
+        // A finished process takes no more input.
+        if (process.isValid() && process.isDone()) {
+            keepTimeAdvance();
+            return;
+        }
+
+        mailbox.push_back(input);
+
+        if (isReceiving || !process.isValid()) {
+            isReceiving = false;
+            resume(r);
+        }
+        else {
+            keepTimeAdvance();
+        }
+    }
+
+    void deltaCon(const Message& input, double r) final {
+        deltaInt(r);
+        deltaExt(input, r);
+    }
+
+    double getNextInternalEvent() final {
+        return outbox.empty() ? wakeTime : now;
+    }
+
+    void saveState(StateBuffer&) const final {
+        throw std::logic_error("the state of a process model cannot be saved");
+    }
+
+    void restoreState(StateBuffer&) final {
+        throw std::logic_error("the state of a process model cannot be restored");
+    }
+};
+#endif
+
+// Cores of the machine grouped by NUMA node, and the means to keep a thread
+// and its memory on one. Linux places a page on the node of the thread that
+// first touches it, so storage copied afresh by a pinned thread is local to
+// that thread.
+class NumaTopology {
+private:
+    std::vector<std::vector<int>> nodes;
+
+    // Parses a list such as "0-3,8,10-11".
+    static std::vector<int> parseCpuList(const std::string& list) {
+        std::vector<int> cores;
+        std::stringstream ranges(list);
+        std::string range;
+
+        while (std::getline(ranges, range, ',')) {
+            std::size_t dash = range.find('-');
+
+            if (range.find_first_of("0123456789") == std::string::npos) {
+                continue;
+            }
+
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+            for (int core = first; core <= last; core++) {
+                cores.push_back(core);
+            }
+        }
+
+        return cores;
+    }
+
+public:
+    explicit NumaTopology(std::vector<std::vector<int>> nodes) : nodes(std::move(nodes)) {
+        if (this->nodes.empty()) {
+            throw std::invalid_argument("a topology needs at least one node");
+        }
+
+        for (const std::vector<int>& cores : this->nodes) {
+            if (cores.empty()) {
+                throw std::invalid_argument("every node of a topology needs a core");
+            }
+        }
+    }
+
+    // The nodes as Linux lists them under /sys/devices/system/node.
+    // Elsewhere, or if that cannot be read, all cores are on one node.
+    static NumaTopology detect() {
+        std::vector<std::vector<int>> nodes;
+
+#ifndef _WIN32
+        for (int node = 0;; node++) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+
+            if (!file || !std::getline(file, list)) {
+                break;
+            }
+
+            std::vector<int> cores = parseCpuList(list);
+
+            if (!cores.empty()) {
+                nodes.push_back(std::move(cores));
+            }
+        }
+#endif
+
+        if (nodes.empty()) {
+            nodes.emplace_back();
+
+            for (unsigned core = 0; core < std::max(1u, std::thread::hardware_concurrency()); core++) {
+                nodes.back().push_back(static_cast<int>(core));
+            }
+        }
+
+        return NumaTopology(std::move(nodes));
+    }
+
+    const std::vector<std::vector<int>>& getNodes() const {
+        return nodes;
+    }
+
+    // Binds the calling thread to one core; false if that is not possible.
+    static bool pinCurrentThread(int core) {
+        if (core < 0) {
+            return false;
+        }
+#ifdef _WIN32
+        if (core >= 64) {
+            return false;
+        }
+
+        return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#else
+        if (core >= CPU_SETSIZE) {
+            return false;
+        }
+
+        cpu_set_t cores;
+        CPU_ZERO(&cores);
+        CPU_SET(core, &cores);
+
+        return pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) == 0;
+#endif
+    }
+
+    // Moves the contents of values into storage the calling thread touches
+    // first. The values are moved, so storage they own stays where it was.
+    template <typename T>
+    static void relocate(std::vector<T>& values) {
+        std::vector<T> local;
+        local.reserve(values.capacity());
+        local.insert(local.end(), std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()));
+        values.swap(local);
+    }
+};
+
+enum class EventKind : unsigned char {
+    Internal,
+    External,
+    Confluent
+};
+
+typedef std::uint32_t InputHandle;
+
+const InputHandle NO_INPUT = std::numeric_limits<InputHandle>::max();
+
+// Plain event record, stored and copied by value. An input string is kept in
+// the EventPool and referenced by handle so the record stays trivially
+// copyable.
+class Event {
+private:
+    Time time;
+    SimulationModel* model;
+    InputHandle input;
+    EventKind kind;
+
+public:
+    Event() = default;
+
+    Event(EventKind kind, const Time& time, SimulationModel* model, InputHandle input = NO_INPUT)
+        : time(time), model(model), input(input), kind(kind) {}
+
+    const Time& getTime() const {
+        return time;
+    }
+
+    SimulationModel* getModel() const {
+        return model;
+    }
+
+    InputHandle getInput() const {
+        return input;
+    }
+
+    EventKind getKind() const {
+        return kind;
+    }
+
+    int compareTo(const Event& other) {
+        // Compare based on the time of the events
+        return this->time.compareTo(other.getTime());
+    }
+};
+
+static_assert(std::is_trivially_copyable<Event>::value, "events are stored and copied by value");
+
+// Read-only view of a run of events owned by someone else, such as the
+// events of a step returned by EventQueue::getNextEvents().
+class EventSpan {
+private:
+    const Event* first;
+    const Event* last;
+
+public:
+    EventSpan(const Event* first = nullptr, const Event* last = nullptr) : first(first), last(last) {}
+
+    const Event* begin() const {
+        return first;
+    }
+
+    const Event* end() const {
+        return last;
+    }
+
+    std::size_t size() const {
+        return static_cast<std::size_t>(last - first);
+    }
+
+    bool empty() const {
+        return first == last;
+    }
+
+    const Event& front() const {
+        return *first;
+    }
+
+    const Event& operator[](std::size_t i) const {
+        return first[i];
+    }
+};
+
+// Backing store for events: the records themselves, held by value in one
+// contiguous array, and the input strings they refer to. Both are recycled
+// through free lists, and a recycled input keeps its capacity, so once the
+// pool has grown to the peak number of live events a run no longer touches
+// the general allocator.
+class EventPool {
+private:
+    std::vector<Event> records;
+    std::vector<EventHandle> freeRecords;
+
+    std::vector<Message> inputs;
+    std::vector<InputHandle> freeInputs;
+
+    std::size_t live;
+    std::size_t highWaterMark;
+
+public:
+    EventPool() : live(0), highWaterMark(0) {}
+
+    EventPool(const EventPool&) = delete;
+    EventPool& operator=(const EventPool&) = delete;
+
+    // Grows the pool so that it can hold at least n live events.
+    void reserve(std::size_t n) {
+        records.reserve(n);
+        inputs.reserve(n);
+    }
+
+    EventHandle create(const Event& event) {
+        live++;
+        highWaterMark = std::max(highWaterMark, live);
+
+        if (freeRecords.empty()) {
+            records.push_back(event);
+            return records.size() - 1;
+        }
+
+        EventHandle handle = freeRecords.back();
+        freeRecords.pop_back();
+        records[handle] = event;
+
+        return handle;
+    }
+
+    Event& get(EventHandle handle) {
+        return records[handle];
+    }
+
+    const Event& get(EventHandle handle) const {
+        return records[handle];
+    }
+
+    void recycle(EventHandle handle) {
+        freeRecords.push_back(handle);
+        live--;
+    }
+
+    InputHandle storeInput(const Message& input, PortId port) {
+        InputHandle handle;
+
+        if (freeInputs.empty()) {
+            inputs.push_back(input);
+            handle = static_cast<InputHandle>(inputs.size() - 1);
+        }
+        else {
+            handle = freeInputs.back();
+            freeInputs.pop_back();
+            inputs[handle] = input;
+        }
+
+        inputs[handle].setPort(port);
+
+        return handle;
+    }
+
+    const Message& getInput(InputHandle handle) const {
+        return inputs[handle];
+    }
+
+    void releaseInput(InputHandle handle) {
+        if (handle != NO_INPUT) {
+            freeInputs.push_back(handle);
+        }
+    }
+
+    std::size_t getLiveCount() const {
+        return live;
+    }
+
+    // Largest number of events that were pending at the same time.
+    std::size_t getHighWaterMark() const {
+        return highWaterMark;
+    }
+
+    std::size_t getCapacity() const {
+        return records.capacity();
+    }
+
+    // Moves the records and inputs to the calling thread's NUMA node.
+    void relocate() {
+        NumaTopology::relocate(records);
+        NumaTopology::relocate(freeRecords);
+        NumaTopology::relocate(inputs);
+        NumaTopology::relocate(freeInputs);
+    }
+};
+
+// Ordering strategy used by the EventQueue. A backend only orders handles by
+// their Time(r, c) key, where c is the super-dense micro-step assigned by the
+// queue. Handles with equal keys come out in the order they were pushed.
+class EventQueueBackend {
+public:
+    virtual void push(const Time& key, EventHandle handle) = 0;
+
+    // Pushes entries sorted by key, in order; backends may merge them in
+    // more cheaply than one push at a time.
+    virtual void pushAll(const std::vector<std::pair<Time, EventHandle>>& entries) {
+        for (const auto& entry : entries) {
+            push(entry.first, entry.second);
+        }
+    }
+
+    virtual EventHandle top() const = 0;
+    virtual const Time& topKey() const = 0;
+    virtual void pop() = 0;
+
+    // Drops a pending handle from the queue. The queue reschedules an event
+    // by removing it and pushing it again.
+    virtual void remove(EventHandle handle) = 0;
+
+    virtual std::size_t size() const = 0;
+
+    bool isEmpty() const {
+        return size() == 0;
+    }
+
+    // Moves the backend's storage to the calling thread's NUMA node.
+    virtual void relocate() {}
+
+    virtual ~EventQueueBackend() = default;
+};
+
+// Implicit d-ary min-heap. D = 2 is a plain binary heap; D = 4 trades a few
+// more comparisons per sift-down for a shallower, more cache-friendly tree.
+struct QueueEntry {
+    Time key;
+    std::uint64_t sequence;
+    EventHandle handle;
+
+    bool operator<(const QueueEntry& other) const {
+        return key < other.key || (key == other.key && sequence < other.sequence);
+    }
+};
+
+template <std::size_t D>
+class DaryHeapBackend : public EventQueueBackend {
+private:
+    typedef QueueEntry Entry;
+
+    std::uint64_t sequence = 0;
+
+    std::vector<Entry> heap;
+
+    // Heap slot of every handle, so remove() needs no search.
+    std::vector<std::size_t> position;
+
+    void place(std::size_t i, const Entry& entry) {
+        heap[i] = entry;
+        position[entry.handle] = i;
+    }
+
+    void siftUp(std::size_t i) {
+        Entry entry = heap[i];
+
+        while (i > 0) {
+            std::size_t parent = (i - 1) / D;
+
+            if (!(entry < heap[parent])) {
+                break;
+            }
+
+            place(i, heap[parent]);
+            i = parent;
+        }
+
+        place(i, entry);
+    }
+
+    void siftDown(std::size_t i) {
+        Entry entry = heap[i];
+        std::size_t n = heap.size();
+
+        while (true) {
+            std::size_t first = i * D + 1;
+
+            if (first >= n) {
+                break;
+            }
+
+            std::size_t last = std::min(first + D, n);
+            std::size_t smallest = first;
+
+            for (std::size_t child = first + 1; child < last; child++) {
+                if (heap[child] < heap[smallest]) {
+                    smallest = child;
+                }
+            }
+
+            if (!(heap[smallest] < entry)) {
+                break;
+            }
+
+            place(i, heap[smallest]);
+            i = smallest;
+        }
+
+        place(i, entry);
+    }
+
+    void removeAt(std::size_t i) {
+        Entry last = heap.back();
+        heap.pop_back();
+
+        if (i == heap.size()) {
+            return;
+        }
+
+        Entry removed = heap[i];
+        place(i, last);
+
+        if (last < removed) {
+            siftUp(i);
+        }
+        else {
+            siftDown(i);
+        }
+    }
+
+public:
+    void push(const Time& key, EventHandle handle) override {
+        if (handle >= position.size()) {
+            position.resize(handle + 1);
+        }
+
+        heap.push_back({ key, sequence++, handle });
+        siftUp(heap.size() - 1);
+    }
+
+    // A batch at least as large as the heap is appended and the whole heap
+    // rebuilt bottom-up, in time linear in its size.
+    void pushAll(const std::vector<std::pair<Time, EventHandle>>& entries) override {
+        if (entries.size() < heap.size()) {
+            EventQueueBackend::pushAll(entries);
+            return;
+        }
+
+        for (const auto& entry : entries) {
+            if (entry.second >= position.size()) {
+                position.resize(entry.second + 1);
+            }
+
+            position[entry.second] = heap.size();
+            heap.push_back({ entry.first, sequence++, entry.second });
+        }
+
+        for (std::size_t i = heap.size() / D + 1; i-- > 0;) {
+            if (i < heap.size()) {
+                siftDown(i);
+            }
+        }
+    }
+
+    EventHandle top() const override {
+        return heap.front().handle;
+    }
+
+    const Time& topKey() const override {
+        return heap.front().key;
+    }
+
+    void pop() override {
+        removeAt(0);
+    }
+
+    void remove(EventHandle handle) override {
+        removeAt(position[handle]);
+    }
+
+    std::size_t size() const override {
+        return heap.size();
+    }
+
+    void relocate() override {
+        NumaTopology::relocate(heap);
+        NumaTopology::relocate(position);
+    }
+};
+
+typedef DaryHeapBackend<2> BinaryHeapBackend;
+typedef DaryHeapBackend<4> QuaternaryHeapBackend;
+
+// Calendar queue (R. Brown, 1988). Events are hashed into "days" of a fixed
+// width; a dequeue walks the calendar from the current day, so when the
+// width matches the spacing of event times both operations are amortized
+// O(1). The calendar is resized as the population doubles or halves.
+class CalendarQueueBackend : public EventQueueBackend {
+private:
+    typedef QueueEntry Entry;
+
+    std::uint64_t sequence = 0;
+
+    // Days must be exact integers for the scan, so keys too far out for
+    // that, such as infinite ones, are kept in time order in far instead
+    // and compared with the earliest of the calendar. count is the number
+    // of entries in the calendar.
+    static constexpr double MAX_DAY = 4503599627370496.0;
+
+    std::vector<std::vector<Entry>> buckets;
+    std::vector<Entry> far;
+    double width;
+    std::size_t count;
+
+    // Key of every handle, to find its bucket on remove().
+    std::vector<Time> keys;
+
+    // Position of the dequeue scan: the bucket being examined and the day it
+    // currently represents. Days are compared as integers so that the scan
+    // and bucketFor() always agree on which day an event falls in.
+    mutable std::size_t currentBucket;
+    mutable double currentDay;
+    mutable bool topIsValid;
+    mutable bool topIsFar;
+
+    double dayOf(double r) const {
+        return std::floor(r / width);
+    }
+
+    bool isFar(double r) const {
+        return !(std::abs(dayOf(r)) < MAX_DAY);
+    }
+
+    std::size_t bucketFor(double r) const {
+        double day = dayOf(r);
+        double n = static_cast<double>(buckets.size());
+
+        return static_cast<std::size_t>(day - std::floor(day / n) * n);
+    }
+
+    void startScanAt(double r) const {
+        currentBucket = bucketFor(r);
+        currentDay = dayOf(r);
+    }
+
+    void locateTop() const {
+        if (topIsValid) {
+            return;
+        }
+
+        topIsValid = true;
+
+        if (count == 0) {
+            topIsFar = true;
+            return;
+        }
+
+        locateCalendarTop();
+        topIsFar = !far.empty() && far.front() < buckets[currentBucket].front();
+    }
+
+    void locateCalendarTop() const {
+        for (std::size_t i = 0; i < buckets.size(); i++) {
+            const std::vector<Entry>& bucket = buckets[currentBucket];
+
+            if (!bucket.empty() && dayOf(bucket.front().key.getR()) <= currentDay) {
+                return;
+            }
+
+            currentBucket = (currentBucket + 1) % buckets.size();
+            currentDay += 1.0;
+        }
+
+        // Nothing in the coming year; jump straight to the earliest event.
+        const Entry* earliest = nullptr;
+
+        for (const std::vector<Entry>& bucket : buckets) {
+            if (!bucket.empty() && (earliest == nullptr || bucket.front() < *earliest)) {
+                earliest = &bucket.front();
+            }
+        }
+
+        startScanAt(earliest->key.getR());
+    }
+
+    void insert(const Entry& entry) {
+        std::vector<Entry>& bucket = buckets[bucketFor(entry.key.getR())];
+
+        bucket.insert(std::upper_bound(bucket.begin(), bucket.end(), entry), entry);
+    }
+
+    // Files a new entry in the calendar or with the far ones; false for a
+    // far one.
+    bool add(const Time& key, EventHandle handle) {
+        if (std::isnan(key.getR())) {
+            throw std::invalid_argument("event at a time that is not a number");
+        }
+
+        if (handle >= keys.size()) {
+            keys.resize(handle + 1);
+        }
+
+        keys[handle] = key;
+        topIsValid = false;
+
+        double day = dayOf(key.getR());
+
+        if (!(std::abs(day) < MAX_DAY)) {
+            Entry entry = { key, sequence++, handle };
+            far.insert(std::upper_bound(far.begin(), far.end(), entry), entry);
+
+            return false;
+        }
+
+        // Restart the scan if the new event lands before the day it is on.
+        if (count == 0 || day < currentDay) {
+            startScanAt(key.getR());
+        }
+
+        insert({ key, sequence++, handle });
+        count++;
+
+        return true;
+    }
+
+    // Estimate a day width from the spacing of the earliest events, as in
+    // Brown's original resize procedure.
+    double estimateWidth(std::vector<Entry>& entries) const {
+        std::size_t samples = std::min<std::size_t>(entries.size(), 25);
+
+        if (samples < 2) {
+            return width;
+        }
+
+        std::partial_sort(entries.begin(), entries.begin() + samples, entries.end(),
+            [](const Entry& a, const Entry& b) { return a < b; });
+
+        double total = 0.0;
+
+        for (std::size_t i = 1; i < samples; i++) {
+            total += entries[i].key.getR() - entries[i - 1].key.getR();
+        }
+
+        double average = total / (samples - 1);
+        double trimmedTotal = 0.0;
+        std::size_t trimmedCount = 0;
+
+        for (std::size_t i = 1; i < samples; i++) {
+            double separation = entries[i].key.getR() - entries[i - 1].key.getR();
+
+            if (separation <= 2.0 * average) {
+                trimmedTotal += separation;
+                trimmedCount++;
+            }
+        }
+
+        double estimate = trimmedCount == 0 ? 0.0 : 3.0 * trimmedTotal / trimmedCount;
+
+        return (estimate > 0.0 && std::isfinite(estimate)) ? estimate : width;
+    }
+
+    void resize(std::size_t bucketCount) {
+        std::vector<Entry> entries;
+        entries.reserve(count);
+
+        for (std::vector<Entry>& bucket : buckets) {
+            entries.insert(entries.end(), bucket.begin(), bucket.end());
+        }
+
+        width = estimateWidth(entries);
+        buckets.assign(bucketCount, std::vector<Entry>());
+
+        // The new width decides which entries are far.
+        entries.insert(entries.end(), far.begin(), far.end());
+        far.clear();
+        count = 0;
+
+        const Entry* earliest = nullptr;
+
+        for (const Entry& entry : entries) {
+            if (isFar(entry.key.getR())) {
+                far.insert(std::upper_bound(far.begin(), far.end(), entry), entry);
+                continue;
+            }
+
+            insert(entry);
+            count++;
+
+            if (earliest == nullptr || entry < *earliest) {
+                earliest = &entry;
+            }
+        }
+
+        topIsValid = false;
+
+        if (earliest != nullptr) {
+            startScanAt(earliest->key.getR());
+        }
+    }
+
+public:
+    CalendarQueueBackend(std::size_t bucketCount = 2, double width = 1.0)
+        : buckets(bucketCount), width(width), count(0), currentBucket(0), currentDay(0.0), topIsValid(false), topIsFar(false) {}
+
+    void push(const Time& key, EventHandle handle) override {
+        if (add(key, handle) && count > 2 * buckets.size()) {
+            resize(2 * buckets.size());
+        }
+    }
+
+    // Entries of one batch usually share a day and so a bucket, where each
+    // lands at the end; the calendar is resized once for the whole batch.
+    void pushAll(const std::vector<std::pair<Time, EventHandle>>& entries) override {
+        if (entries.empty()) {
+            return;
+        }
+
+        for (const auto& entry : entries) {
+            add(entry.first, entry.second);
+        }
+
+        std::size_t bucketCount = buckets.size();
+
+        while (count > 2 * bucketCount) {
+            bucketCount *= 2;
+        }
+
+        if (bucketCount != buckets.size()) {
+            resize(bucketCount);
+        }
+    }
+
+    EventHandle top() const override {
+        locateTop();
+        return topIsFar ? far.front().handle : buckets[currentBucket].front().handle;
+    }
+
+    const Time& topKey() const override {
+        locateTop();
+        return topIsFar ? far.front().key : buckets[currentBucket].front().key;
+    }
+
+    void pop() override {
+        locateTop();
+        topIsValid = false;
+
+        if (topIsFar) {
+            far.erase(far.begin());
+            return;
+        }
+
+        std::vector<Entry>& bucket = buckets[currentBucket];
+        bucket.erase(bucket.begin());
+        count--;
+
+        if (buckets.size() > 2 && count < buckets.size() / 2) {
+            resize(buckets.size() / 2);
+        }
+    }
+
+    void remove(EventHandle handle) override {
+        double r = keys[handle].getR();
+        std::vector<Entry>& bucket = isFar(r) ? far : buckets[bucketFor(r)];
+
+        bucket.erase(std::find_if(bucket.begin(), bucket.end(),
+            [handle](const Entry& entry) { return entry.handle == handle; }));
+        topIsValid = false;
+
+        if (&bucket != &far) {
+            count--;
+        }
+    }
+
+    std::size_t size() const override {
+        return count + far.size();
+    }
+
+    void relocate() override {
+        // Each bucket is copied into fresh storage of its own, as moving
+        // the buckets would only move the pointers to their entries.
+        for (std::vector<Entry>& bucket : buckets) {
+            NumaTopology::relocate(bucket);
+        }
+
+        NumaTopology::relocate(buckets);
+        NumaTopology::relocate(far);
+        NumaTopology::relocate(keys);
+    }
+};
+
+class EventQueue {
+private:
+    EventPool& pool;
+    std::unique_ptr<EventQueueBackend> backend;
+
+    // Time of the step most recently taken off the queue.
+    Time now;
+
+    // Events of the step most recently taken off the queue, with their
+    // handles and the models with external events among them.
+    std::vector<Event> nextEvents;
+    std::vector<EventHandle> nextHandles;
+    std::vector<SimulationModel*> receivers;
+
+    // Events made by batchExternalEvent() that are not in the backend yet.
+    std::vector<std::pair<Time, EventHandle>> batch;
+
+    EventHandle push(const Event& event) {
+        EventHandle handle = pool.create(event);
+        backend->push(event.getTime(), handle);
+
+        return handle;
+    }
+
+    // Events scheduled at the r of the current step go to its next
+    // micro-step; anything later starts at micro-step 0 of its r.
+    Time timeFor(double r) const {
+        Time time(r, 0);
+
+        return time.isSimultaneousWith(now) ? Time(r, now.getC() + 1) : time;
+    }
+
+    static bool compareFirst(const std::pair<Time, EventHandle>& a, const std::pair<Time, EventHandle>& b) {
+        return a.first < b.first;
+    }
+
+    // The first pending external event of the model at time, if any.
+    std::vector<EventHandle>::iterator findExternalEvent(SimulationModel* model, const Time& time) {
+        std::vector<EventHandle>& externals = model->externalEvents;
+
+        return std::find_if(externals.begin(), externals.end(),
+            [&](EventHandle handle) { return pool.get(handle).getTime() == time; });
+    }
+
+    void forgetEvent(EventHandle handle, SimulationModel* model) {
+        if (model->internalEvent == handle) {
+            model->internalEvent = NO_EVENT;
+            model->scheduledTime = std::numeric_limits<double>::infinity();
+            return;
+        }
+
+        std::vector<EventHandle>& externals = model->externalEvents;
+        externals.erase(std::find(externals.begin(), externals.end(), handle));
+    }
+
+public:
+    EventQueue(EventPool& pool, std::unique_ptr<EventQueueBackend> backend = std::unique_ptr<EventQueueBackend>(new BinaryHeapBackend()))
+        : pool(pool), backend(std::move(backend)), now(-std::numeric_limits<double>::infinity(), 0) {}
+
+    EventQueue(const EventQueue&) = delete;
+    EventQueue& operator=(const EventQueue&) = delete;
+
+    // Models may already be gone, so they are not touched.
+    ~EventQueue() {
+        while (!backend->isEmpty()) {
+            EventHandle handle = backend->top();
+            backend->pop();
+
+            pool.releaseInput(pool.get(handle).getInput());
+            pool.recycle(handle);
+        }
+    }
+
+    // Drops every pending event along with its input.
+    void clear() {
+        while (!backend->isEmpty()) {
+            EventHandle handle = backend->top();
+            backend->pop();
+
+            const Event& event = pool.get(handle);
+            pool.releaseInput(event.getInput());
+            forgetEvent(handle, event.getModel());
+            pool.recycle(handle);
+        }
+    }
+
+    void scheduleInternalEvent(double r, SimulationModel* model) {
+        scheduleInternalEvent(timeFor(r), model);
+    }
+
+    void scheduleInternalEvent(const Time& time, SimulationModel* model) {
+        EventHandle handle = model->internalEvent;
+
+        if (handle != NO_EVENT && pool.get(handle).getTime() == time) {
+            return;
+        }
+
+        cancelInternalEvent(model);
+
+        auto external = findExternalEvent(model, time);
+
+        if (external != model->externalEvents.end()) {
+            EventHandle externalHandle = *external;
+            model->externalEvents.erase(external);
+            scheduleConfluentEvent(model, externalHandle);
+            return;
+        }
+
+        model->internalEvent = push(Event(EventKind::Internal, time, model));
+        model->scheduledTime = time.getR();
+    }
+
+    // Upgrades the event behind handle in place; its time, and so its place
+    // in the queue, is unchanged.
+    void scheduleConfluentEvent(SimulationModel* model, EventHandle handle) {
+        Event& event = pool.get(handle);
+        event = Event(EventKind::Confluent, event.getTime(), model, event.getInput());
+        model->internalEvent = handle;
+        model->scheduledTime = event.getTime().getR();
+    }
+
+    void scheduleExternalEvent(const Message& input, double r, SimulationModel* model) {
+        scheduleExternalEvent(input, input.getPort(), r, model);
+    }
+
+    // Delivers input to the given input port of the model.
+    void scheduleExternalEvent(const Message& input, PortId port, double r, SimulationModel* model) {
+        scheduleExternalEvent(input, port, timeFor(r), model);
+    }
+
+    // As above, at an explicit super-dense time, e.g. for a message that
+    // arrives from another logical process.
+    void scheduleExternalEvent(const Message& input, PortId port, const Time& time, SimulationModel* model) {
+        EventHandle handle = model->internalEvent;
+
+        if (handle != NO_EVENT) {
+            Event& event = pool.get(handle);
+
+            if (event.getKind() == EventKind::Internal && event.getTime() == time) {
+                event = Event(EventKind::Confluent, time, model, pool.storeInput(input, port));
+                return;
+            }
+        }
+
+        Event event(EventKind::External, time, model, pool.storeInput(input, port));
+        model->externalEvents.push_back(push(event));
+    }
+
+    // As scheduleExternalEvent(), except that the event only goes into the
+    // queue with the rest of its batch on scheduleBatch(). A collision with
+    // the model's internal event is still merged right away. The queue must
+    // not be read while a batch is open.
+    void batchExternalEvent(const Message& input, PortId port, double r, SimulationModel* model) {
+        Time time = timeFor(r);
+        EventHandle handle = model->internalEvent;
+
+        if (handle != NO_EVENT) {
+            Event& event = pool.get(handle);
+
+            if (event.getKind() == EventKind::Internal && event.getTime() == time) {
+                event = Event(EventKind::Confluent, time, model, pool.storeInput(input, port));
+                return;
+            }
+        }
+
+        handle = pool.create(Event(EventKind::External, time, model, pool.storeInput(input, port)));
+        model->externalEvents.push_back(handle);
+        batch.emplace_back(time, handle);
+    }
+
+    // Sorts the batch once and merges it into the queue in a single pass.
+    // Events with equal times keep the order they were batched in.
+    std::size_t scheduleBatch() {
+        std::size_t count = batch.size();
+
+        if (!std::is_sorted(batch.begin(), batch.end(), compareFirst)) {
+            std::stable_sort(batch.begin(), batch.end(), compareFirst);
+        }
+
+        backend->pushAll(batch);
+        batch.clear();
+
+        return count;
+    }
+
+    // Withdraws the model's pending internal event. A confluent event keeps
+    // its external input, so it is turned back into an external event.
+    void cancelInternalEvent(SimulationModel* model) {
+        EventHandle handle = model->internalEvent;
+
+        if (handle == NO_EVENT) {
+            return;
+        }
+
+        model->internalEvent = NO_EVENT;
+        model->scheduledTime = std::numeric_limits<double>::infinity();
+        Event& event = pool.get(handle);
+
+        if (event.getKind() == EventKind::Confluent) {
+            event = Event(EventKind::External, event.getTime(), model, event.getInput());
+            model->externalEvents.push_back(handle);
+        }
+        else {
+            backend->remove(handle);
+            pool.recycle(handle);
+        }
+    }
+
+    // Removes every event at the earliest time (r, c). Inputs of the
+    // returned events stay in the pool until the caller releases them. The
+    // events are kept in a buffer the queue reuses, so the view is only
+    // valid until the next call.
+    EventSpan getNextEvents() {
+        nextEvents.clear();
+
+        if (backend->isEmpty()) {
+            return EventSpan();
+        }
+
+        now = backend->topKey();
+        nextHandles.clear();
+        receivers.clear();
+
+        while (!backend->isEmpty() && backend->topKey() == now) {
+            EventHandle handle = backend->top();
+            backend->pop();
+
+            const Event& event = pool.get(handle);
+            nextEvents.push_back(event);
+            nextHandles.push_back(handle);
+
+            if (event.getModel()->internalEvent == handle) {
+                event.getModel()->internalEvent = NO_EVENT;
+                event.getModel()->scheduledTime = std::numeric_limits<double>::quiet_NaN();
+            }
+            else {
+                receivers.push_back(event.getModel());
+            }
+        }
+
+        // Every external event of a model at this time leaves in this step,
+        // so each model's list is compacted once, however many inputs it
+        // receives.
+        std::sort(receivers.begin(), receivers.end());
+        receivers.erase(std::unique(receivers.begin(), receivers.end()), receivers.end());
+
+        for (SimulationModel* model : receivers) {
+            std::vector<EventHandle>& externals = model->externalEvents;
+            externals.erase(std::remove_if(externals.begin(), externals.end(),
+                [this](EventHandle handle) { return pool.get(handle).getTime() == now; }), externals.end());
+        }
+
+        for (EventHandle handle : nextHandles) {
+            pool.recycle(handle);
+        }
+
+        return EventSpan(nextEvents.data(), nextEvents.data() + nextEvents.size());
+    }
+
+    const Message& getInput(const Event& event) const {
+        return pool.getInput(event.getInput());
+    }
+
+    // Every pending event in queue order, with its input. The events are put
+    // back in the same order, so only their handles change.
+    std::vector<std::pair<Event, Message>> getPendingEvents() {
+        std::vector<std::pair<Event, Message>> pending;
+
+        while (!backend->isEmpty()) {
+            EventHandle handle = backend->top();
+            backend->pop();
+
+            const Event& event = pool.get(handle);
+            pending.emplace_back(event, event.getKind() == EventKind::Internal ? Message() : pool.getInput(event.getInput()));
+            pool.releaseInput(event.getInput());
+            forgetEvent(handle, event.getModel());
+            pool.recycle(handle);
+        }
+
+        for (const auto& entry : pending) {
+            insert(entry.first.getKind(), entry.first.getTime(), entry.first.getModel(), entry.second);
+        }
+
+        return pending;
+    }
+
+    // Adds an event as it was taken from a queue, without merging it.
+    void insert(EventKind kind, const Time& time, SimulationModel* model, const Message& input) {
+        if (kind == EventKind::Internal) {
+            model->internalEvent = push(Event(kind, time, model));
+            model->scheduledTime = time.getR();
+            return;
+        }
+
+        EventHandle handle = push(Event(kind, time, model, pool.storeInput(input, input.getPort())));
+
+        if (kind == EventKind::Confluent) {
+            model->internalEvent = handle;
+            model->scheduledTime = time.getR();
+        }
+        else {
+            model->externalEvents.push_back(handle);
+        }
+    }
+
+    void setCurrentTime(const Time& time) {
+        now = time;
+    }
+
+    // Time of the model's pending internal event; r is infinite if none.
+    Time internalEventTime(SimulationModel* model) const {
+        if (model->internalEvent == NO_EVENT) {
+            return Time(std::numeric_limits<double>::infinity(), 0);
+        }
+
+        return pool.get(model->internalEvent).getTime();
+    }
+
+    double timeAdvance() const {
+        return backend->topKey().getR();
+    }
+
+    const Time& nextEventTime() const {
+        return backend->topKey();
+    }
+
+    const Time& currentTime() const {
+        return now;
+    }
+
+    bool isEmpty() const {
+        return backend->isEmpty();
+    }
+
+    void relocate() {
+        backend->relocate();
+        NumaTopology::relocate(nextEvents);
+        NumaTopology::relocate(batch);
+    }
+
+    std::size_t size() const {
+        return backend->size();
+    }
+};
+
+// Fixed set of worker threads for data-parallel loops. parallelFor() splits
+// a range into chunks dealt out to per-thread deques; a thread works from
+// the back of its own deque and, once that is empty, steals from the front
+// of the others'. The calling thread takes part and the call returns once
+// every chunk has run, rethrowing the first exception any of them threw.
+class ThreadPool {
+private:
+    struct Range {
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+    };
+
+    std::vector<std::thread> threads;
+
+    // One queue per worker, plus a last one for the calling thread.
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+
+    const std::function<void(std::size_t, std::size_t)>* body;
+    std::atomic<std::size_t> remaining;
+
+    // The first exception a chunk threw, rethrown to the caller once every
+    // chunk is accounted for; chunks not yet started are then skipped.
+    std::exception_ptr failure;
+    std::atomic<bool> hasFailed{ false };
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::size_t generation;
+    bool stopping;
+
+    bool takeRange(std::size_t self, Range& range) {
+        {
+            WorkQueue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+
+            if (!own.ranges.empty()) {
+                range = own.ranges.back();
+                own.ranges.pop_back();
+                return true;
+            }
+        }
+
+        for (std::size_t i = 1; i < queues.size(); i++) {
+            WorkQueue& victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+
+            if (!victim.ranges.empty()) {
+                range = victim.ranges.front();
+                victim.ranges.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void work(std::size_t self) {
+        Range range;
+
+        while (takeRange(self, range)) {
+            if (!hasFailed.load(std::memory_order_relaxed)) {
+                try {
+                    (*body)(range.begin, range.end);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+
+                    if (!failure) {
+                        failure = std::current_exception();
+                    }
+
+                    hasFailed.store(true, std::memory_order_relaxed);
+                }
+            }
+
+            if (remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+
+    void workerLoop(std::size_t self) {
+        std::size_t seen = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+
+                if (stopping) {
+                    return;
+                }
+
+                seen = generation;
+            }
+
+            work(self);
+        }
+    }
+
+public:
+    ThreadPool(std::size_t threadCount = std::thread::hardware_concurrency())
+        : body(nullptr), remaining(0), generation(0), stopping(false) {
+        std::size_t workers = threadCount > 1 ? threadCount - 1 : 0;
+
+        for (std::size_t i = 0; i <= workers; i++) {
+            queues.emplace_back(new WorkQueue());
+        }
+
+        for (std::size_t i = 0; i < workers; i++) {
+            threads.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        wake.notify_all();
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Number of threads taking part in a loop, the caller included.
+    std::size_t size() const {
+        return queues.size();
+    }
+
+    // Runs body(begin, end) over [0, count) in chunks of at least grain.
+    void parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& body) {
+        if (count == 0) {
+            return;
+        }
+
+        if (threads.empty() || count <= grain) {
+            body(0, count);
+            return;
+        }
+
+        std::size_t chunks = std::min((count + grain - 1) / grain, 4 * queues.size());
+        std::size_t chunkSize = (count + chunks - 1) / chunks;
+        chunks = (count + chunkSize - 1) / chunkSize;
+
+        this->body = &body;
+        remaining.store(chunks);
+
+        for (std::size_t i = 0; i < chunks; i++) {
+            WorkQueue& queue = *queues[i % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.ranges.push_back({ i * chunkSize, std::min(count, (i + 1) * chunkSize) });
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+        }
+
+        wake.notify_all();
+        work(queues.size() - 1);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return remaining.load() == 0; });
+
+        if (failure) {
+            std::exception_ptr thrown = failure;
+            failure = nullptr;
+            hasFailed.store(false, std::memory_order_relaxed);
+            std::rethrow_exception(thrown);
+        }
+    }
+};
+
+// Supplies inputs to the simulator in time order. The simulator pulls the
+// next input only once the run has caught up with the previous one, so a
+// source can be far longer than what fits in the event queue.
+class InputSource {
+public:
+    // Sets the next input and its time, or returns false once exhausted.
+    virtual bool next(double& r, Message& input) = 0;
+
+    // How far the source has got, for checkpoints. Sources that keep no
+    // position of their own, such as most generators, keep the defaults.
+    virtual void saveState(StateBuffer&) const {}
+    virtual void restoreState(StateBuffer&) {}
+
+    virtual ~InputSource() = default;
+};
+
+class GeneratorSource : public InputSource {
+private:
+    std::function<bool(double&, Message&)> generator;
+
+public:
+    GeneratorSource(std::function<bool(double&, Message&)> generator) : generator(std::move(generator)) {}
+
+    bool next(double& r, Message& input) override {
+        return generator(r, input);
+    }
+};
+
+// Walks a range of (time, input) pairs, e.g. of a map or vector.
+template <typename Iterator>
+class IteratorSource : public InputSource {
+private:
+    Iterator first;
+    Iterator current;
+    Iterator last;
+    std::uint64_t position = 0;
+
+public:
+    IteratorSource(Iterator first, Iterator last) : first(first), current(first), last(last) {}
+
+    bool next(double& r, Message& input) override {
+        if (current == last) {
+            return false;
+        }
+
+        r = current->first;
+        input = current->second;
+        ++current;
+        position++;
+
+        return true;
+    }
+
+    void saveState(StateBuffer& state) const override {
+        state.write(position);
+    }
+
+    void restoreState(StateBuffer& state) override {
+        state.read(position);
+        current = first;
+        std::advance(current, position);
+    }
+};
+
+// Reads one input per line as a time and a value. Values that parse as an
+// integer or a real are sent as one; anything else is sent as text. Blank
+// lines are skipped.
+class FileInputSource : public InputSource {
+private:
+    // tellg() is not const, though it leaves the stream as it was.
+    mutable std::ifstream file;
+    std::string line;
+
+public:
+    FileInputSource(const std::string& path) : file(path) {
+        if (!file) {
+            throw std::runtime_error("cannot open " + path);
+        }
+    }
+
+    bool next(double& r, Message& input) override {
+        while (std::getline(file, line)) {
+            const char* text = line.c_str();
+            char* end;
+
+            r = std::strtod(text, &end);
+
+            if (end == text) {
+                if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                    continue;
+                }
+
+                throw std::runtime_error("bad input time: " + line);
+            }
+
+            std::size_t start = line.find_first_not_of(" \t", end - text);
+            std::size_t stop = line.find_last_not_of(" \t\r");
+            std::string value = start == std::string::npos ? "" : line.substr(start, stop - start + 1);
+
+            long long integer = std::strtoll(value.c_str(), &end, 10);
+
+            if (!value.empty() && *end == '\0') {
+                input = Message(integer);
+                return true;
+            }
+
+            double real = std::strtod(value.c_str(), &end);
+
+            if (!value.empty() && *end == '\0') {
+                input = Message(real);
+                return true;
+            }
+
+            input = Message(value);
+            return true;
+        }
+
+        return false;
+    }
+
+    void saveState(StateBuffer& state) const override {
+        std::int64_t offset = file.eof() ? -1 : static_cast<std::int64_t>(file.tellg());
+        state.write(offset);
+    }
+
+    void restoreState(StateBuffer& state) override {
+        std::int64_t offset;
+        state.read(offset);
+
+        file.clear();
+
+        if (offset < 0) {
+            file.seekg(0, std::ios::end);
+            file.get();
+        }
+        else {
+            file.seekg(offset);
+        }
+    }
+};
+
+// Lock-free multi-producer, single-consumer queue of inputs handed to a
+// running simulator from other threads (D. Vyukov's intrusive queue). A
+// push is one atomic exchange; the simulation thread pops.
+class InputInbox {
+private:
+    struct Node {
+        std::atomic<Node*> next{ nullptr };
+        Message input;
+    };
+
+    std::atomic<Node*> head;
+    Node* tail;
+    Node stub;
+
+    void push(Node* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+public:
+    InputInbox() : head(&stub), tail(&stub) {}
+
+    InputInbox(const InputInbox&) = delete;
+    InputInbox& operator=(const InputInbox&) = delete;
+
+    ~InputInbox() {
+        Message input;
+
+        while (pop(input)) {}
+    }
+
+    // Safe from any thread.
+    void push(const Message& input) {
+        Node* node = new Node;
+        node->input = input;
+        push(node);
+    }
+
+    // Simulation thread only, as is pop().
+    bool isEmpty() const {
+        return tail == &stub && stub.next.load(std::memory_order_acquire) == nullptr;
+    }
+
+    // An input whose push is still under way may be missed, and is then
+    // taken by a later call.
+    bool pop(Message& input) {
+        Node* first = tail;
+        Node* next = first->next.load(std::memory_order_acquire);
+
+        if (first == &stub) {
+            if (next == nullptr) {
+                return false;
+            }
+
+            tail = next;
+            first = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next == nullptr) {
+            if (first != head.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            push(&stub);
+            next = first->next.load(std::memory_order_acquire);
+
+            if (next == nullptr) {
+                return false;
+            }
+        }
+
+        tail = next;
+        input = std::move(first->input);
+        delete first;
+
+        return true;
+    }
+};
+
+// Receives the simulator's outputs as they are produced, in place of the
+// trace simulate() otherwise returns. Sinks are handed the raw messages, so
+// any formatting is up to them.
+class OutputSink {
+public:
+    virtual void write(double r, const Message& output) = 0;
+
+    // Called once simulate() is done.
+    virtual void flush() {}
+
+    virtual ~OutputSink() = default;
+};
+
+class CallbackSink : public OutputSink {
+private:
+    std::function<void(double, const Message&)> callback;
+
+public:
+    CallbackSink(std::function<void(double, const Message&)> callback) : callback(std::move(callback)) {}
+
+    void write(double r, const Message& output) override {
+        callback(r, output);
+    }
+};
+
+// Writes outputs to a file in the format of the trace. Outputs are batched
+// and each full batch is formatted and written by a writer thread while the
+// simulation fills the next. A write that fails on that thread, e.g. on a
+// full disk, is thrown from the next flush() or close().
+class FileSink : public OutputSink {
+private:
+    struct Record {
+        double r;
+        Message output;
+    };
+
+    const std::string path;
+    std::FILE* file;
+    std::size_t batchSize;
+    std::vector<Record> filling;
+    std::vector<Record> pending;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool hasPending = false;
+    bool isWriting = false;
+    bool isStopping = false;
+    bool isFailed = false;
+    std::thread writer;
+
+    void writeBatches() {
+        std::vector<Record> batch;
+        std::stringstream text;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return hasPending || isStopping; });
+
+                if (!hasPending) {
+                    return;
+                }
+
+                batch.swap(pending);
+                hasPending = false;
+                isWriting = true;
+            }
+
+            condition.notify_all();
+
+            text.str("");
+
+            for (const Record& record : batch) {
+                text << record.r << " - " << record.output << "\n";
+            }
+
+            std::string bytes = text.str();
+            bool isWritten = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+            batch.clear();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                isWriting = false;
+                isFailed = isFailed || !isWritten;
+            }
+
+            condition.notify_all();
+        }
+    }
+
+    // Waits for the writer to take the previous batch, then hands it this one.
+    void handOver() {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return !hasPending; });
+
+        pending.swap(filling);
+        hasPending = true;
+        lock.unlock();
+
+        condition.notify_all();
+    }
+
+public:
+    FileSink(const std::string& path, std::size_t batchSize = 4096) : path(path), batchSize(std::max<std::size_t>(1, batchSize)) {
+        file = std::fopen(path.c_str(), "w");
+
+        if (file == nullptr) {
+            throw std::runtime_error("cannot open " + path);
+        }
+
+        filling.reserve(this->batchSize);
+        writer = std::thread([this] { writeBatches(); });
+    }
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    // A sink not closed before is closed here, and a failed write goes
+    // unreported; close() reports it.
+    ~FileSink() {
+        try {
+            close();
+        }
+        catch (const std::runtime_error&) {}
+    }
+
+    void write(double r, const Message& output) override {
+        filling.push_back({ r, output });
+
+        if (filling.size() >= batchSize) {
+            handOver();
+        }
+    }
+
+    // Returns once everything written so far is in the file, or throws if
+    // any of it could not be written.
+    void flush() override {
+        if (file == nullptr) {
+            return;
+        }
+
+        if (!filling.empty()) {
+            handOver();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return !hasPending && !isWriting; });
+        isFailed = isFailed || std::fflush(file) != 0;
+
+        if (isFailed) {
+            throw std::runtime_error("cannot write " + path);
+        }
+    }
+
+    // Writes what is left, stops the writer thread and closes the file;
+    // throws if any of the outputs could not be written.
+    void close() {
+        if (file == nullptr) {
+            return;
+        }
+
+        if (!filling.empty()) {
+            handOver();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isStopping = true;
+        }
+
+        condition.notify_all();
+        writer.join();
+
+        isFailed = isFailed || std::fclose(file) != 0;
+        file = nullptr;
+
+        if (isFailed) {
+            throw std::runtime_error("cannot write " + path);
+        }
+    }
+};
+
+// Lock-free single-producer, single-consumer ring for handing outputs to a
+// consumer thread. The simulation waits while the ring is full; once it is
+// done, close() lets the consumer drain what is left and stop.
+class RingBufferSink : public OutputSink {
+private:
+    struct Record {
+        double r;
+        Message output;
+    };
+
+    std::vector<Record> slots;
+    std::size_t mask;
+
+    // Count of records ever taken and ever written; each side only stores
+    // its own.
+    alignas(64) std::atomic<std::size_t> head{ 0 };
+    alignas(64) std::atomic<std::size_t> tail{ 0 };
+    std::atomic<bool> isClosed{ false };
+
+public:
+    // The capacity is rounded up to a power of two.
+    RingBufferSink(std::size_t capacity = 4096) {
+        std::size_t size = 1;
+
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    void write(double r, const Message& output) override {
+        std::size_t position = tail.load(std::memory_order_relaxed);
+
+        while (position - head.load(std::memory_order_acquire) == slots.size()) {
+            std::this_thread::yield();
+        }
+
+        slots[position & mask] = { r, output };
+        tail.store(position + 1, std::memory_order_release);
+    }
+
+    void close() {
+        isClosed.store(true, std::memory_order_release);
+    }
+
+    // Takes the oldest output if there is one.
+    bool tryRead(double& r, Message& output) {
+        std::size_t position = head.load(std::memory_order_relaxed);
+
+        if (position == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        Record& record = slots[position & mask];
+        r = record.r;
+        output = std::move(record.output);
+        head.store(position + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Waits for the next output; returns false once the ring is closed and
+    // has been drained.
+    bool read(double& r, Message& output) {
+        while (!tryRead(r, output)) {
+            if (isClosed.load(std::memory_order_acquire)) {
+                return tryRead(r, output);
+            }
+
+            std::this_thread::yield();
+        }
+
+        return true;
+    }
+};
+
+enum class TraceKind : unsigned char {
+    Internal,
+    External,
+    Confluent,
+    Output
+};
+
+// Fixed-width record of a binary trace: an event a model went through, with
+// its input, or an output the simulator emitted. Text payloads live in the
+// text section; the record holds their offset there and their length.
+struct TraceRecord {
+    double r;
+    std::int32_t c;
+    std::uint32_t model;
+    TraceKind kind;
+    Message::Type type;
+    PortId port;
+    std::uint32_t size;
+    unsigned char payload[Message::INLINE_SIZE];
+};
+
+static_assert(sizeof(TraceRecord) == 40, "trace records are 40 bytes");
+
+// Every INDEX_STRIDE-th record's time is kept in an index at the end of the
+// file, so readers can seek by time without touching the records.
+struct TraceIndexEntry {
+    double r;
+    std::int32_t c;
+    std::uint32_t reserved;
+    std::uint64_t record;
+};
+
+// Layout: header, records, text section, index. Values are stored in the
+// byte order of the machine that wrote them.
+struct TraceHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    std::uint64_t recordCount;
+    std::uint64_t recordsOffset;
+    std::uint64_t textOffset;
+    std::uint64_t textSize;
+    std::uint64_t indexOffset;
+    std::uint64_t indexCount;
+    std::uint64_t indexStride;
+};
+
+static const char TRACE_MAGIC[8] = { 'D', 'E', 'V', 'S', 'T', 'R', 'C', '\0' };
+static const std::uint32_t TRACE_VERSION = 1;
+
+class BinaryTraceWriter {
+private:
+    static const std::size_t BATCH_SIZE = 4096;
+    static const std::size_t INDEX_STRIDE = 1024;
+
+    const std::string path;
+    std::FILE* file;
+    std::FILE* text;
+    std::uint64_t recordCount = 0;
+    std::uint64_t textSize = 0;
+    std::vector<TraceRecord> batch;
+    std::vector<TraceIndexEntry> index;
+    bool isFailed = false;
+
+    // Writes all count items or throws, e.g. when the disk is full. A trace
+    // that lost a write cannot be completed.
+    void put(std::FILE* to, const void* items, std::size_t itemSize, std::size_t count) {
+        if (std::fwrite(items, itemSize, count, to) != count) {
+            isFailed = true;
+            throw std::runtime_error("cannot write " + path);
+        }
+    }
+
+    void writeBatch() {
+        put(file, batch.data(), sizeof(TraceRecord), batch.size());
+        batch.clear();
+    }
+
+    // Closes both files; false if the trace's last writes failed.
+    bool release() {
+        bool isWritten = std::fclose(file) == 0;
+        std::fclose(text);
+        file = nullptr;
+        text = nullptr;
+
+        return isWritten;
+    }
+
+    // Appends the text section and index and fills in the header.
+    void finish() {
+        if (isFailed) {
+            throw std::runtime_error("cannot write " + path);
+        }
+
+        writeBatch();
+
+        TraceHeader header = {};
+        std::memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.version = TRACE_VERSION;
+        header.recordSize = sizeof(TraceRecord);
+        header.recordCount = recordCount;
+        header.recordsOffset = sizeof(TraceHeader);
+        header.textOffset = header.recordsOffset + recordCount * sizeof(TraceRecord);
+        header.textSize = textSize;
+        header.indexOffset = (header.textOffset + textSize + 7) / 8 * 8;
+        header.indexCount = index.size();
+        header.indexStride = INDEX_STRIDE;
+
+        std::rewind(text);
+        std::vector<char> buffer(1 << 16);
+        std::size_t read;
+
+        while ((read = std::fread(buffer.data(), 1, buffer.size(), text)) > 0) {
+            put(file, buffer.data(), 1, read);
+        }
+
+        if (std::ferror(text)) {
+            throw std::runtime_error("cannot write " + path);
+        }
+
+        const char padding[8] = {};
+        put(file, padding, 1, static_cast<std::size_t>(header.indexOffset - header.textOffset - textSize));
+        put(file, index.data(), sizeof(TraceIndexEntry), index.size());
+
+        if (std::fseek(file, 0, SEEK_SET) != 0) {
+            throw std::runtime_error("cannot write " + path);
+        }
+
+        put(file, &header, sizeof(header), 1);
+    }
+
+public:
+    BinaryTraceWriter(const std::string& path) : path(path) {
+        file = std::fopen(path.c_str(), "wb");
+        text = std::tmpfile();
+
+        if (file == nullptr || text == nullptr) {
+            if (file != nullptr) {
+                std::fclose(file);
+            }
+
+            if (text != nullptr) {
+                std::fclose(text);
+            }
+
+            throw std::runtime_error("cannot open " + path);
+        }
+
+        TraceHeader header = {};
+
+        if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+            release();
+            throw std::runtime_error("cannot write " + path);
+        }
+
+        batch.reserve(BATCH_SIZE);
+    }
+
+    BinaryTraceWriter(const BinaryTraceWriter&) = delete;
+    BinaryTraceWriter& operator=(const BinaryTraceWriter&) = delete;
+
+    // A trace not closed before is closed here, and left incomplete if that
+    // fails; close() says so.
+    ~BinaryTraceWriter() {
+        try {
+            close();
+        }
+        catch (const std::runtime_error&) {}
+    }
+
+    // Records go out in batches; the call that fills one throws if it
+    // cannot be written.
+    void write(const Time& time, std::size_t model, TraceKind kind, const Message& payload) {
+        if (recordCount % INDEX_STRIDE == 0) {
+            index.push_back({ time.getR(), time.getC(), 0, recordCount });
+        }
+
+        TraceRecord record;
+        record.r = time.getR();
+        record.c = time.getC();
+        record.model = static_cast<std::uint32_t>(model);
+        record.kind = kind;
+        record.type = payload.getType();
+        record.port = payload.getPort();
+
+        if (payload.getType() == Message::Type::Text) {
+            const std::string& value = payload.getText();
+            record.size = static_cast<std::uint32_t>(value.size());
+            std::memset(record.payload, 0, sizeof(record.payload));
+            std::memcpy(record.payload, &textSize, sizeof(textSize));
+
+            put(text, value.data(), 1, value.size());
+            textSize += value.size();
+        }
+        else {
+            record.size = static_cast<std::uint32_t>(payload.getSize());
+            std::memcpy(record.payload, payload.getBytes(), sizeof(record.payload));
+        }
+
+        batch.push_back(record);
+        recordCount++;
+
+        if (batch.size() == BATCH_SIZE) {
+            writeBatch();
+        }
+    }
+
+    // Completes the trace. Throws if it could not be written in full; the
+    // files are closed either way.
+    void close() {
+        if (file == nullptr) {
+            return;
+        }
+
+        try {
+            finish();
+        }
+        catch (const std::runtime_error&) {
+            release();
+            throw;
+        }
+
+        if (!release()) {
+            throw std::runtime_error("cannot write " + path);
+        }
+    }
+};
+
+// Maps a binary trace into memory read-only; records are read in place.
+class BinaryTraceReader {
+private:
+    const unsigned char* data = nullptr;
+    std::size_t length = 0;
+    const TraceHeader* header = nullptr;
+    const TraceRecord* records = nullptr;
+    const TraceIndexEntry* index = nullptr;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    void map(const std::string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        LARGE_INTEGER size;
+
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+            throw std::runtime_error("cannot open " + path);
+        }
+
+        length = static_cast<std::size_t>(size.QuadPart);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (mapping != nullptr) {
+            data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        struct stat status;
+
+        if (descriptor < 0 || ::fstat(descriptor, &status) != 0) {
+            if (descriptor >= 0) {
+                ::close(descriptor);
+            }
+
+            throw std::runtime_error("cannot open " + path);
+        }
+
+        length = static_cast<std::size_t>(status.st_size);
+        void* address = length > 0 ? ::mmap(nullptr, length, PROT_READ, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+        ::close(descriptor);
+
+        if (address != MAP_FAILED) {
+            data = static_cast<const unsigned char*>(address);
+        }
+#endif
+
+        if (data == nullptr) {
+            unmap();
+            throw std::runtime_error("cannot map " + path);
+        }
+    }
+
+    void unmap() {
+#ifdef _WIN32
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (data != nullptr) {
+            ::munmap(const_cast<unsigned char*>(data), length);
+        }
+#endif
+        data = nullptr;
+    }
+
+public:
+    BinaryTraceReader(const std::string& path) {
+        map(path);
+
+        header = reinterpret_cast<const TraceHeader*>(data);
+
+        // Sections in order, aligned and inside the file; each bound is
+        // checked before it is used, so corrupt sizes cannot overflow.
+        bool isValid = length >= sizeof(TraceHeader)
+            && std::memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0
+            && header->version == TRACE_VERSION
+            && header->recordSize == sizeof(TraceRecord)
+            && header->recordsOffset >= sizeof(TraceHeader) && header->recordsOffset <= length && header->recordsOffset % 8 == 0
+            && header->recordCount <= (length - header->recordsOffset) / sizeof(TraceRecord)
+            && header->textOffset == header->recordsOffset + header->recordCount * sizeof(TraceRecord)
+            && header->textSize <= length - header->textOffset
+            && header->indexOffset >= header->textOffset + header->textSize && header->indexOffset <= length && header->indexOffset % 8 == 0
+            && header->indexCount <= (length - header->indexOffset) / sizeof(TraceIndexEntry);
+
+        if (!isValid) {
+            unmap();
+            throw std::runtime_error("not a binary trace: " + path);
+        }
+
+        records = reinterpret_cast<const TraceRecord*>(data + header->recordsOffset);
+        index = reinterpret_cast<const TraceIndexEntry*>(data + header->indexOffset);
+    }
+
+    BinaryTraceReader(const BinaryTraceReader&) = delete;
+    BinaryTraceReader& operator=(const BinaryTraceReader&) = delete;
+
+    ~BinaryTraceReader() {
+        unmap();
+    }
+
+    std::size_t size() const {
+        return static_cast<std::size_t>(header->recordCount);
+    }
+
+    const TraceRecord& operator[](std::size_t i) const {
+        return records[i];
+    }
+
+    const TraceRecord* begin() const {
+        return records;
+    }
+
+    const TraceRecord* end() const {
+        return records + size();
+    }
+
+    static Time getTime(const TraceRecord& record) {
+        return Time(record.r, record.c);
+    }
+
+    // Text of a text payload, without copying it out of the file.
+    std::string_view getText(const TraceRecord& record) const {
+        std::uint64_t offset;
+        std::memcpy(&offset, record.payload, sizeof(offset));
+
+        if (offset > header->textSize || record.size > header->textSize - offset) {
+            throw std::runtime_error("text of a trace record is outside the text section");
+        }
+
+        return std::string_view(reinterpret_cast<const char*>(data + header->textOffset + offset), record.size);
+    }
+
+    Message getPayload(const TraceRecord& record) const {
+        Message payload = record.type == Message::Type::Text
+            ? Message(std::string(getText(record)))
+            : Message::fromBytes(record.type, record.payload, record.size);
+
+        return payload.setPort(record.port);
+    }
+
+    // Position of the first record at or after time.
+    std::size_t lowerBound(const Time& time) const {
+        const TraceIndexEntry* last = index + header->indexCount;
+        const TraceIndexEntry* entry = std::upper_bound(index, last, time,
+            [](const Time& t, const TraceIndexEntry& e) { return t < Time(e.r, e.c) || t == Time(e.r, e.c); });
+
+        std::size_t first = entry == index ? 0 : static_cast<std::size_t>((entry - 1)->record);
+        std::size_t bound = entry == last ? size() : static_cast<std::size_t>(entry->record);
+
+        return std::lower_bound(records + first, records + bound, time,
+            [](const TraceRecord& record, const Time& t) { return getTime(record) < t; }) - records;
+    }
+};
+
+// Wakes a logical process that is waiting for its neighbours.
+class WakeSignal {
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool raised = false;
+
+public:
+    void raise() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            raised = true;
+        }
+
+        condition.notify_one();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return raised; });
+        raised = false;
+    }
+};
+
+// One-way link for messages crossing from one logical process to another.
+// Messages carry the super-dense time of the step they arrive in, which is
+// what a single simulator would have given them. The clock is the sender's
+// promise that nothing earlier will follow; a null message only raises it.
+// For optimistic runs the sender keeps a journal of what it sent, so that a
+// rollback can chase each message with an anti-message cancelling it.
+class Channel {
+public:
+    struct Delivery {
+        Time time;
+        Message message;
+        std::uint64_t sequence;
+        bool isAnti;
+    };
+
+private:
+    std::mutex mutex;
+    std::vector<Delivery> deliveries;
+    Time clock;
+    SimulationModel* destination;
+    PortId port;
+    double lookahead;
+    WakeSignal* receiver = nullptr;
+
+    // Touched by the sending thread only.
+    std::uint64_t nextSequence = 0;
+    bool isJournaled = false;
+    std::vector<Delivery> journal;
+
+    void post(const Delivery& delivery) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            deliveries.push_back(delivery);
+            clock = std::max(clock, delivery.time);
+        }
+
+        receiver->raise();
+    }
+
+public:
+    Channel(SimulationModel* destination, PortId port, double lookahead)
+        : clock(-std::numeric_limits<double>::infinity(), 0), destination(destination), port(port), lookahead(lookahead) {}
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    void send(const Time& time, const Message& message) {
+        Delivery delivery = { time, message, nextSequence++, false };
+
+        if (isJournaled) {
+            journal.push_back(delivery);
+        }
+
+        post(delivery);
+    }
+
+    // Cancels every journaled message stamped later than time and returns
+    // how many anti-messages went out.
+    std::size_t retract(const Time& time) {
+        std::size_t count = 0;
+
+        while (!journal.empty() && time < journal.back().time) {
+            Delivery anti = journal.back();
+            anti.isAnti = true;
+            anti.message = Message();
+            journal.pop_back();
+
+            post(anti);
+            count++;
+        }
+
+        return count;
+    }
+
+    // Forgets journaled messages stamped before time, which can no longer
+    // be cancelled.
+    void forgetBefore(const Time& time) {
+        auto first = std::find_if(journal.begin(), journal.end(),
+            [&](const Delivery& delivery) { return !(delivery.time < time); });
+
+        journal.erase(journal.begin(), first);
+    }
+
+    void setJournaled(bool journaled) {
+        isJournaled = journaled;
+    }
+
+    void advanceClock(const Time& time) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (!(clock < time)) {
+                return;
+            }
+
+            clock = time;
+        }
+
+        receiver->raise();
+    }
+
+    // Moves the pending messages into out and returns the clock they were
+    // sent under.
+    Time receive(std::vector<Delivery>& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (Delivery& delivery : deliveries) {
+            out.push_back(std::move(delivery));
+        }
+
+        deliveries.clear();
+
+        return clock;
+    }
+
+    bool isEmpty() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return deliveries.empty();
+    }
+
+    void setReceiver(WakeSignal* signal) {
+        receiver = signal;
+    }
+
+    SimulationModel* getDestination() const {
+        return destination;
+    }
+
+    PortId getPort() const {
+        return port;
+    }
+
+    double getLookahead() const {
+        return lookahead;
+    }
+};
+
+// An input scheduled to a model, as logged by an optimistic logical process
+// to rebuild its queue after a rollback. Local inputs come from couplings
+// inside the process and are regenerated when it rolls back past them;
+// the others arrived over a channel or were given to the simulator.
+struct LoggedInput {
+    Time time;
+    SimulationModel* destination;
+    PortId port;
+    Message message;
+    Channel* channel;
+    std::uint64_t sequence;
+    bool isLocal;
+};
+
+static const char CHECKPOINT_MAGIC[8] = { 'D', 'E', 'V', 'S', 'C', 'K', 'P', '\0' };
+static const std::uint32_t CHECKPOINT_VERSION = 2;
+
+// Splits a weighted graph into parts of about equal vertex weight while
+// keeping the weight of the edges cut between parts low, as METIS does:
+// the graph is coarsened by heavy-edge matching, the coarsest graph is
+// bisected by greedy growing, and the bisection is refined with
+// Fiduccia-Mattheyses moves on every level on the way back. k parts come
+// from recursive bisection. The result depends only on the graph.
+class GraphPartitioner {
+private:
+    struct Graph {
+        std::vector<double> vertexWeights;
+        std::vector<std::size_t> offsets;
+        std::vector<std::size_t> neighbours;
+        std::vector<double> edgeWeights;
+
+        std::size_t size() const {
+            return vertexWeights.size();
+        }
+    };
+
+    struct Edge {
+        std::size_t from;
+        std::size_t to;
+        double weight;
+    };
+
+    static constexpr std::size_t NONE = std::numeric_limits<std::size_t>::max();
+    static constexpr std::size_t COARSEST = 40;
+    static constexpr int REFINEMENT_PASSES = 8;
+    static constexpr int GROWING_TRIES = 4;
+
+    std::vector<double> vertexWeights;
+    std::vector<Edge> edges;
+
+    // Parallel edges are merged.
+    static Graph build(const std::vector<double>& vertexWeights, const std::vector<Edge>& edges) {
+        std::vector<Edge> directed;
+        directed.reserve(2 * edges.size());
+
+        for (const Edge& edge : edges) {
+            directed.push_back(edge);
+            directed.push_back({ edge.to, edge.from, edge.weight });
+        }
+
+        std::sort(directed.begin(), directed.end(),
+            [](const Edge& a, const Edge& b) { return a.from != b.from ? a.from < b.from : a.to < b.to; });
+
+        Graph graph;
+        graph.vertexWeights = vertexWeights;
+        graph.offsets.assign(vertexWeights.size() + 1, 0);
+
+        for (std::size_t i = 0; i < directed.size(); i++) {
+            const Edge& edge = directed[i];
+
+            if (i > 0 && directed[i - 1].from == edge.from && directed[i - 1].to == edge.to) {
+                graph.edgeWeights.back() += edge.weight;
+                continue;
+            }
+
+            graph.neighbours.push_back(edge.to);
+            graph.edgeWeights.push_back(edge.weight);
+            graph.offsets[edge.from + 1]++;
+        }
+
+        for (std::size_t v = 0; v < graph.size(); v++) {
+            graph.offsets[v + 1] += graph.offsets[v];
+        }
+
+        return graph;
+    }
+
+    // Merges each vertex with the unmatched neighbour it shares the
+    // heaviest edge with; coarseOf maps every vertex to its merged vertex.
+    static Graph coarsen(const Graph& graph, double maxVertexWeight, std::vector<std::size_t>& coarseOf) {
+        std::size_t n = graph.size();
+        std::vector<std::size_t> order(n);
+
+        for (std::size_t v = 0; v < n; v++) {
+            order[v] = v;
+        }
+
+        // Light vertices choose first, so they are not left without partners.
+        std::stable_sort(order.begin(), order.end(),
+            [&](std::size_t a, std::size_t b) { return graph.vertexWeights[a] < graph.vertexWeights[b]; });
+
+        coarseOf.assign(n, NONE);
+        std::size_t coarseCount = 0;
+
+        for (std::size_t v : order) {
+            if (coarseOf[v] != NONE) {
+                continue;
+            }
+
+            std::size_t partner = NONE;
+            double heaviest = -1.0;
+
+            for (std::size_t k = graph.offsets[v]; k < graph.offsets[v + 1]; k++) {
+                std::size_t u = graph.neighbours[k];
+
+                if (coarseOf[u] == NONE && graph.edgeWeights[k] > heaviest && graph.vertexWeights[u] + graph.vertexWeights[v] <= maxVertexWeight) {
+                    partner = u;
+                    heaviest = graph.edgeWeights[k];
+                }
+            }
+
+            coarseOf[v] = coarseCount;
+
+            if (partner != NONE) {
+                coarseOf[partner] = coarseCount;
+            }
+
+            coarseCount++;
+        }
+
+        std::vector<std::size_t> memberOffsets(coarseCount + 1, 0);
+        std::vector<std::size_t> members(n);
+
+        for (std::size_t v = 0; v < n; v++) {
+            memberOffsets[coarseOf[v] + 1]++;
+        }
+
+        for (std::size_t c = 0; c < coarseCount; c++) {
+            memberOffsets[c + 1] += memberOffsets[c];
+        }
+
+        std::vector<std::size_t> cursor(memberOffsets.begin(), memberOffsets.end() - 1);
+
+        for (std::size_t v = 0; v < n; v++) {
+            members[cursor[coarseOf[v]]++] = v;
+        }
+
+        Graph coarse;
+        coarse.vertexWeights.assign(coarseCount, 0.0);
+        coarse.offsets.assign(coarseCount + 1, 0);
+
+        std::vector<std::size_t> seenBy(coarseCount, NONE);
+        std::vector<std::size_t> slot(coarseCount);
+
+        for (std::size_t c = 0; c < coarseCount; c++) {
+            for (std::size_t m = memberOffsets[c]; m < memberOffsets[c + 1]; m++) {
+                std::size_t v = members[m];
+                coarse.vertexWeights[c] += graph.vertexWeights[v];
+
+                for (std::size_t k = graph.offsets[v]; k < graph.offsets[v + 1]; k++) {
+                    std::size_t u = coarseOf[graph.neighbours[k]];
+
+                    if (u == c) {
+                        continue;
+                    }
+
+                    if (seenBy[u] != c) {
+                        seenBy[u] = c;
+                        slot[u] = coarse.neighbours.size();
+                        coarse.neighbours.push_back(u);
+                        coarse.edgeWeights.push_back(0.0);
+                    }
+
+                    coarse.edgeWeights[slot[u]] += graph.edgeWeights[k];
+                }
+            }
+
+            coarse.offsets[c + 1] = coarse.neighbours.size();
+        }
+
+        return coarse;
+    }
+
+    static double cut(const Graph& graph, const std::vector<char>& side) {
+        double weight = 0.0;
+
+        for (std::size_t v = 0; v < graph.size(); v++) {
+            for (std::size_t k = graph.offsets[v]; k < graph.offsets[v + 1]; k++) {
+                if (side[v] != side[graph.neighbours[k]]) {
+                    weight += graph.edgeWeights[k];
+                }
+            }
+        }
+
+        return weight / 2;
+    }
+
+    static double sideWeight(const Graph& graph, const std::vector<char>& side) {
+        double weight = 0.0;
+
+        for (std::size_t v = 0; v < graph.size(); v++) {
+            if (side[v] == 0) {
+                weight += graph.vertexWeights[v];
+            }
+        }
+
+        return weight;
+    }
+
+    // Orders bisections: within tolerance first, then by cut, then by how
+    // close side 0 is to its target.
+    static bool isBetter(double cutA, double errorA, double cutB, double errorB, double tolerance) {
+        bool balancedA = errorA <= tolerance;
+        bool balancedB = errorB <= tolerance;
+
+        if (balancedA != balancedB) {
+            return balancedA;
+        }
+
+        if (!balancedA || cutA == cutB) {
+            return errorA < errorB;
+        }
+
+        return cutA < cutB;
+    }
+
+    // Grows side 0 from seed, always by the vertex most strongly tied to it,
+    // until it holds about target weight.
+    static std::vector<char> grow(const Graph& graph, std::size_t seed, double target) {
+        std::size_t n = graph.size();
+        std::vector<char> side(n, 1);
+        std::vector<double> ties(n, 0.0);
+        std::vector<std::pair<double, std::size_t>> frontier;
+        std::size_t unvisited = 0;
+        double weight = 0.0;
+
+        frontier.emplace_back(0.0, seed);
+
+        while (weight < target) {
+            std::size_t v = NONE;
+
+            while (!frontier.empty()) {
+                std::pop_heap(frontier.begin(), frontier.end());
+                std::pair<double, std::size_t> entry = frontier.back();
+                frontier.pop_back();
+
+                if (side[entry.second] == 1 && entry.first == ties[entry.second]) {
+                    v = entry.second;
+                    break;
+                }
+            }
+
+            // A disconnected graph carries on from any vertex left.
+            while (v == NONE && unvisited < n) {
+                if (side[unvisited] == 1) {
+                    v = unvisited;
+                }
+
+                unvisited++;
+            }
+
+            if (v == NONE || weight + graph.vertexWeights[v] - target > target - weight) {
+                break;
+            }
+
+            side[v] = 0;
+            weight += graph.vertexWeights[v];
+
+            for (std::size_t k = graph.offsets[v]; k < graph.offsets[v + 1]; k++) {
+                std::size_t u = graph.neighbours[k];
+
+                if (side[u] == 1) {
+                    ties[u] += graph.edgeWeights[k];
+                    frontier.emplace_back(ties[u], u);
+                    std::push_heap(frontier.begin(), frontier.end());
+                }
+            }
+        }
+
+        return side;
+    }
+
+    // Fiduccia-Mattheyses passes: vertices move to the other side one at a
+    // time, the best gain first and each at most once a pass, while side 0
+    // stays within tolerance of its target or gets closer to it. Each pass
+    // keeps the best prefix of its moves.
+    static void refine(const Graph& graph, std::vector<char>& side, double target, double tolerance) {
+        std::size_t n = graph.size();
+        std::vector<double> gains(n);
+        std::vector<char> isLocked(n);
+        std::vector<std::pair<double, std::size_t>> candidates;
+        std::vector<std::size_t> moves;
+
+        for (int pass = 0; pass < REFINEMENT_PASSES; pass++) {
+            candidates.clear();
+            moves.clear();
+            std::fill(isLocked.begin(), isLocked.end(), 0);
+
+            for (std::size_t v = 0; v < n; v++) {
+                double gain = 0.0;
+                bool isBoundary = false;
+
+                for (std::size_t k = graph.offsets[v]; k < graph.offsets[v + 1]; k++) {
+                    bool isAcross = side[graph.neighbours[k]] != side[v];
+                    gain += isAcross ? graph.edgeWeights[k] : -graph.edgeWeights[k];
+                    isBoundary = isBoundary || isAcross;
+                }
+
+                gains[v] = gain;
+
+                if (isBoundary) {
+                    candidates.emplace_back(gain, v);
+                }
+            }
+
+            std::make_heap(candidates.begin(), candidates.end());
+
+            double weight = sideWeight(graph, side);
+            double currentCut = cut(graph, side);
+            double bestCut = currentCut;
+            double bestError = std::abs(weight - target);
+            std::size_t bestLength = 0;
+            std::size_t patience = std::max<std::size_t>(50, n / 20);
+
+            while (!candidates.empty() && moves.size() - bestLength < patience) {
+                std::pop_heap(candidates.begin(), candidates.end());
+                std::pair<double, std::size_t> entry = candidates.back();
+                candidates.pop_back();
+
+                std::size_t v = entry.second;
+
+                if (isLocked[v] || entry.first != gains[v]) {
+                    continue;
+                }
+
+                double moved = weight + (side[v] == 0 ? -graph.vertexWeights[v] : graph.vertexWeights[v]);
+                double error = std::abs(moved - target);
+
+                if (error > tolerance && error >= std::abs(weight - target)) {
+                    continue;
+                }
+
+                side[v] ^= 1;
+                isLocked[v] = 1;
+                weight = moved;
+                currentCut -= gains[v];
+                moves.push_back(v);
+
+                for (std::size_t k = graph.offsets[v]; k < graph.offsets[v + 1]; k++) {
+                    std::size_t u = graph.neighbours[k];
+
+                    if (!isLocked[u]) {
+                        gains[u] += side[u] == side[v] ? -2 * graph.edgeWeights[k] : 2 * graph.edgeWeights[k];
+                        candidates.emplace_back(gains[u], u);
+                        std::push_heap(candidates.begin(), candidates.end());
+                    }
+                }
+
+                if (isBetter(currentCut, error, bestCut, bestError, tolerance)) {
+                    bestCut = currentCut;
+                    bestError = error;
+                    bestLength = moves.size();
+                }
+            }
+
+            for (std::size_t i = moves.size(); i > bestLength; i--) {
+                side[moves[i - 1]] ^= 1;
+            }
+
+            if (bestLength == 0) {
+                break;
+            }
+        }
+    }
+
+    // Moves vertices off the heavier side, the cheapest in cut first, until
+    // side 0 is within tolerance of its target or no move brings it closer.
+    // Refinement alone can leave the imbalance of the coarse levels, whose
+    // vertices are too heavy to balance finely.
+    static void balance(const Graph& graph, std::vector<char>& side, double target, double tolerance) {
+        double weight = sideWeight(graph, side);
+        char heavy = weight > target ? 0 : 1;
+        double excess = std::abs(weight - target);
+
+        if (excess <= tolerance) {
+            return;
+        }
+
+        std::size_t n = graph.size();
+        std::vector<double> gains(n, 0.0);
+        std::vector<char> isLocked(n, 0);
+        std::vector<std::pair<double, std::size_t>> candidates;
+
+        for (std::size_t v = 0; v < n; v++) {
+            if (side[v] != heavy) {
+                continue;
+            }
+
+            for (std::size_t k = graph.offsets[v]; k < graph.offsets[v + 1]; k++) {
+                gains[v] += side[graph.neighbours[k]] != heavy ? graph.edgeWeights[k] : -graph.edgeWeights[k];
+            }
+
+            candidates.emplace_back(gains[v], v);
+        }
+
+        std::make_heap(candidates.begin(), candidates.end());
+
+        while (excess > tolerance && !candidates.empty()) {
+            std::pop_heap(candidates.begin(), candidates.end());
+            std::pair<double, std::size_t> entry = candidates.back();
+            candidates.pop_back();
+
+            std::size_t v = entry.second;
+
+            if (isLocked[v] || entry.first != gains[v]) {
+                continue;
+            }
+
+            isLocked[v] = 1;
+
+            // Too heavy to move now, and the excess only shrinks.
+            if (graph.vertexWeights[v] >= 2 * excess) {
+                continue;
+            }
+
+            side[v] ^= 1;
+            excess -= graph.vertexWeights[v];
+
+            for (std::size_t k = graph.offsets[v]; k < graph.offsets[v + 1]; k++) {
+                std::size_t u = graph.neighbours[k];
+
+                if (side[u] == heavy && !isLocked[u]) {
+                    gains[u] += 2 * graph.edgeWeights[k];
+                    candidates.emplace_back(gains[u], u);
+                    std::push_heap(candidates.begin(), candidates.end());
+                }
+            }
+        }
+    }
+
+    // Moves vertices onto side which, the cheapest in cut first, until it
+    // holds at least count of them.
+    static void fill(const Graph& graph, std::vector<char>& side, char which, std::size_t count) {
+        std::size_t size = static_cast<std::size_t>(std::count(side.begin(), side.end(), which));
+
+        while (size < count) {
+            std::size_t best = NONE;
+            double bestGain = 0.0;
+
+            for (std::size_t v = 0; v < graph.size(); v++) {
+                if (side[v] == which) {
+                    continue;
+                }
+
+                double gain = 0.0;
+
+                for (std::size_t k = graph.offsets[v]; k < graph.offsets[v + 1]; k++) {
+                    gain += side[graph.neighbours[k]] == which ? graph.edgeWeights[k] : -graph.edgeWeights[k];
+                }
+
+                if (best == NONE || gain > bestGain) {
+                    best = v;
+                    bestGain = gain;
+                }
+            }
+
+            side[best] = which;
+            size++;
+        }
+    }
+
+    static double maxVertexWeight(const Graph& graph) {
+        return graph.size() == 0 ? 0.0 : *std::max_element(graph.vertexWeights.begin(), graph.vertexWeights.end());
+    }
+
+    // Side 0 gets about fraction of the weight, each side within imbalance
+    // of its own weight where the vertices allow it.
+    static std::vector<char> bisect(const Graph& graph, double fraction, double imbalance) {
+        double total = 0.0;
+
+        for (double weight : graph.vertexWeights) {
+            total += weight;
+        }
+
+        std::vector<Graph> levels;
+        std::vector<std::vector<std::size_t>> coarseOf;
+        const Graph* finest = &graph;
+
+        while (finest->size() > COARSEST) {
+            std::vector<std::size_t> map;
+            Graph coarse = coarsen(*finest, 1.5 * total / COARSEST, map);
+
+            if (coarse.size() > finest->size() * 95 / 100) {
+                break;
+            }
+
+            coarseOf.push_back(std::move(map));
+            levels.push_back(std::move(coarse));
+            finest = &levels.back();
+        }
+
+        const Graph& coarsest = levels.empty() ? graph : levels.back();
+        double target = total * fraction;
+        double budget = imbalance * std::min(target, total - target);
+
+        std::vector<char> side;
+        double bestCut = 0.0;
+        double bestError = 0.0;
+        double tolerance = std::max(budget, maxVertexWeight(coarsest));
+        std::mt19937_64 random(coarsest.size());
+
+        for (int attempt = 0; attempt < GROWING_TRIES && coarsest.size() > 0; attempt++) {
+            std::size_t seed = std::uniform_int_distribution<std::size_t>(0, coarsest.size() - 1)(random);
+            std::vector<char> grown = grow(coarsest, seed, target);
+            refine(coarsest, grown, target, tolerance);
+
+            double grownCut = cut(coarsest, grown);
+            double error = std::abs(sideWeight(coarsest, grown) - target);
+
+            if (side.empty() || isBetter(grownCut, error, bestCut, bestError, tolerance)) {
+                side = std::move(grown);
+                bestCut = grownCut;
+                bestError = error;
+            }
+        }
+
+        for (std::size_t level = levels.size(); level > 0; level--) {
+            const Graph& fine = level == 1 ? graph : levels[level - 2];
+            const std::vector<std::size_t>& map = coarseOf[level - 1];
+            std::vector<char> projected(fine.size());
+
+            for (std::size_t v = 0; v < fine.size(); v++) {
+                projected[v] = side[map[v]];
+            }
+
+            side = std::move(projected);
+            refine(fine, side, target, std::max(budget, maxVertexWeight(fine)));
+        }
+
+        if (!side.empty()) {
+            balance(graph, side, target, budget);
+            refine(graph, side, target, budget);
+        }
+
+        return side;
+    }
+
+    // The vertices on one side, as a graph of their own.
+    static Graph extract(const Graph& graph, const std::vector<char>& side, char which, std::vector<std::size_t>& vertices) {
+        std::vector<std::size_t> local(graph.size(), NONE);
+        std::vector<std::size_t> kept;
+
+        for (std::size_t v = 0; v < graph.size(); v++) {
+            if (side[v] == which) {
+                local[v] = kept.size();
+                kept.push_back(v);
+            }
+        }
+
+        Graph part;
+        part.offsets.push_back(0);
+
+        for (std::size_t v : kept) {
+            part.vertexWeights.push_back(graph.vertexWeights[v]);
+
+            for (std::size_t k = graph.offsets[v]; k < graph.offsets[v + 1]; k++) {
+                if (local[graph.neighbours[k]] != NONE) {
+                    part.neighbours.push_back(local[graph.neighbours[k]]);
+                    part.edgeWeights.push_back(graph.edgeWeights[k]);
+                }
+            }
+
+            part.offsets.push_back(part.neighbours.size());
+        }
+
+        std::vector<std::size_t> original;
+
+        for (std::size_t v : kept) {
+            original.push_back(vertices[v]);
+        }
+
+        vertices = std::move(original);
+
+        return part;
+    }
+
+    // Parts first to first + parts - 1, each getting its share of graph.
+    // The imbalance is spread over the levels of bisection left so that it
+    // compounds to no more than asked.
+    static void split(const Graph& graph, std::vector<std::size_t> vertices, const std::vector<double>& shares, std::size_t parts, std::size_t first,
+        double imbalance, std::vector<std::size_t>& partOf) {
+        if (parts == 1 || graph.size() == 0) {
+            for (std::size_t v : vertices) {
+                partOf[v] = first;
+            }
+
+            return;
+        }
+
+        std::size_t left = parts / 2;
+        double leftShare = 0.0;
+        double totalShare = 0.0;
+
+        for (std::size_t part = first; part < first + parts; part++) {
+            totalShare += shares[part];
+            leftShare += part < first + left ? shares[part] : 0.0;
+        }
+
+        int levels = 0;
+
+        while ((std::size_t(1) << levels) < parts) {
+            levels++;
+        }
+
+        double levelImbalance = std::pow(1.0 + imbalance, 1.0 / levels) - 1.0;
+        double rest = (1.0 + imbalance) / (1.0 + levelImbalance) - 1.0;
+        std::vector<char> side = bisect(graph, leftShare / totalShare, levelImbalance);
+
+        // No part is left empty while there are vertices for all of them.
+        if (graph.size() >= parts) {
+            fill(graph, side, 0, left);
+            fill(graph, side, 1, parts - left);
+        }
+
+        std::vector<std::size_t> leftVertices = vertices;
+        Graph leftGraph = extract(graph, side, 0, leftVertices);
+        split(leftGraph, std::move(leftVertices), shares, left, first, rest, partOf);
+
+        Graph rightGraph = extract(graph, side, 1, vertices);
+        split(rightGraph, std::move(vertices), shares, parts - left, first + left, rest, partOf);
+    }
+
+public:
+    explicit GraphPartitioner(std::size_t vertexCount) : vertexWeights(vertexCount, 1.0) {}
+
+    void setVertexWeight(std::size_t v, double weight) {
+        vertexWeights.at(v) = weight;
+    }
+
+    // Edges are undirected; adding one twice adds up the weights.
+    void addEdge(std::size_t u, std::size_t v, double weight) {
+        if (u >= vertexWeights.size() || v >= vertexWeights.size()) {
+            throw std::out_of_range("edge to a vertex that is not in the graph");
+        }
+
+        if (u != v) {
+            edges.push_back({ u, v, weight });
+        }
+    }
+
+    // The part, from 0 to parts - 1, of every vertex. Parts stay within the
+    // imbalance of their share of the weight, or within one vertex where the
+    // vertices are heavier than that.
+    std::vector<std::size_t> partition(std::size_t parts, double imbalance = 0.03) const {
+        if (parts == 0) {
+            throw std::invalid_argument("a graph cannot be split into no parts");
+        }
+
+        return partition(std::vector<double>(parts, 1.0), imbalance);
+    }
+
+    // As above, part i getting shares[i] of the weight in proportion to the
+    // other shares.
+    std::vector<std::size_t> partition(const std::vector<double>& shares, double imbalance = 0.03) const {
+        if (shares.empty()) {
+            throw std::invalid_argument("a graph cannot be split into no parts");
+        }
+
+        for (double share : shares) {
+            if (!(share > 0.0)) {
+                throw std::invalid_argument("every part needs a positive share");
+            }
+        }
+
+        std::vector<std::size_t> vertices(vertexWeights.size());
+
+        for (std::size_t v = 0; v < vertices.size(); v++) {
+            vertices[v] = v;
+        }
+
+        std::vector<std::size_t> partOf(vertexWeights.size(), 0);
+        split(build(vertexWeights, edges), std::move(vertices), shares, shares.size(), 0, imbalance, partOf);
+
+        return partOf;
+    }
+
+    // Weight of the edges between different parts.
+    double cutWeight(const std::vector<std::size_t>& partOf) const {
+        double weight = 0.0;
+
+        for (const Edge& edge : edges) {
+            if (partOf.at(edge.from) != partOf.at(edge.to)) {
+                weight += edge.weight;
+            }
+        }
+
+        return weight;
+    }
+};
+
+// What a model was doing when it was timed.
+enum class Phase { Lambda, DeltaInt, DeltaExt, DeltaCon };
+
+// Counters of a Simulator's hot path, kept only in builds that define
+// DEVS_INSTRUMENTATION; otherwise every call below is an empty inline
+// function and the simulator carries no extra state. Per-model slots are
+// only written by the thread running that model, so parallel steps need
+// no locking.
+#ifdef DEVS_INSTRUMENTATION
+class Instrumentation {
+public:
+    typedef std::chrono::steady_clock::time_point Stamp;
+
+private:
+    struct ModelTiming {
+        std::uint64_t calls[4] = {};
+        std::uint64_t nanoseconds[4] = {};
+    };
+
+    struct QueueSample {
+        double r;
+        std::size_t length;
+    };
+
+    // Queue lengths are sampled every sampleInterval steps. Once there are
+    // MAX_SAMPLES of them every other one is dropped and the interval
+    // doubled, so long runs keep an even, bounded record.
+    static const std::size_t MAX_SAMPLES = 4096;
+
+    std::uint64_t steps = 0;
+    std::uint64_t events[3] = {};
+    std::uint64_t schedules = 0;
+    std::uint64_t scheduleNanoseconds = 0;
+    std::uint64_t popNanoseconds = 0;
+
+    std::size_t queueLength = 0;
+    std::size_t maxQueueLength = 0;
+    double totalQueueLength = 0.0;
+    std::uint64_t sampleInterval = 1;
+    std::vector<QueueSample> queueSamples;
+
+    std::vector<ModelTiming> models;
+
+    static std::uint64_t nanosecondsSince(Stamp started) {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+    }
+
+    static const char* phaseName(std::size_t phase) {
+        static const char* names[] = { "lambda", "deltaInt", "deltaExt", "deltaCon" };
+        return names[phase];
+    }
+
+    static const char* kindName(std::size_t kind) {
+        static const char* names[] = { "internal", "external", "confluent" };
+        return names[kind];
+    }
+
+public:
+    void resize(std::size_t modelCount) {
+        if (models.size() < modelCount) {
+            models.resize(modelCount);
+        }
+    }
+
+    Stamp start() const {
+        return std::chrono::steady_clock::now();
+    }
+
+    void recordModel(std::size_t id, Phase phase, Stamp started) {
+        if (id < models.size()) {
+            models[id].calls[static_cast<std::size_t>(phase)]++;
+            models[id].nanoseconds[static_cast<std::size_t>(phase)] += nanosecondsSince(started);
+        }
+    }
+
+    // Time since started spent scheduling or cancelling count events.
+    void recordSchedule(Stamp started, std::size_t count = 1) {
+        schedules += count;
+        scheduleNanoseconds += nanosecondsSince(started);
+    }
+
+    void recordPop(Stamp started) {
+        popNanoseconds += nanosecondsSince(started);
+    }
+
+    // A confluent event is an internal and an external event colliding.
+    void recordStep(EventSpan stepEvents, std::size_t length) {
+        for (const Event& event : stepEvents) {
+            events[static_cast<std::size_t>(event.getKind())]++;
+        }
+
+        queueLength = length;
+        maxQueueLength = std::max(maxQueueLength, length);
+        totalQueueLength += static_cast<double>(length);
+
+        if (steps++ % sampleInterval == 0) {
+            if (queueSamples.size() == MAX_SAMPLES) {
+                for (std::size_t i = 0; i < MAX_SAMPLES / 2; i++) {
+                    queueSamples[i] = queueSamples[2 * i];
+                }
+
+                queueSamples.resize(MAX_SAMPLES / 2);
+                sampleInterval *= 2;
+            }
+
+            queueSamples.push_back({ stepEvents.front().getTime().getR(), length });
+        }
+    }
+
+    std::string toJson() const {
+        std::ostringstream out;
+        out.precision(9);
+
+        out << "{\"steps\":" << steps << ",\"events\":{";
+
+        for (std::size_t kind = 0; kind < 3; kind++) {
+            out << (kind == 0 ? "" : ",") << "\"" << kindName(kind) << "\":" << events[kind];
+        }
+
+        out << "},\"queue\":{\"length\":" << queueLength << ",\"maxLength\":" << maxQueueLength
+            << ",\"meanLength\":" << (steps == 0 ? 0.0 : totalQueueLength / steps)
+            << ",\"schedules\":" << schedules << ",\"scheduleSeconds\":" << scheduleNanoseconds * 1e-9
+            << ",\"popSeconds\":" << popNanoseconds * 1e-9 << ",\"samples\":[";
+
+        for (std::size_t i = 0; i < queueSamples.size(); i++) {
+            out << (i == 0 ? "" : ",") << "[" << queueSamples[i].r << "," << queueSamples[i].length << "]";
+        }
+
+        out << "]},\"models\":[";
+
+        for (std::size_t id = 0; id < models.size(); id++) {
+            out << (id == 0 ? "" : ",") << "{\"id\":" << id;
+
+            for (std::size_t phase = 0; phase < 4; phase++) {
+                out << ",\"" << phaseName(phase) << "\":{\"calls\":" << models[id].calls[phase]
+                    << ",\"seconds\":" << models[id].nanoseconds[phase] * 1e-9 << "}";
+            }
+
+            out << "}";
+        }
+
+        out << "]}";
+
+        return out.str();
+    }
+
+    // Prometheus text exposition format.
+    std::string toPrometheus() const {
+        std::ostringstream out;
+        out.precision(9);
+
+        out << "# TYPE devs_steps_total counter\n"
+            << "devs_steps_total " << steps << "\n"
+            << "# TYPE devs_events_total counter\n";
+
+        for (std::size_t kind = 0; kind < 3; kind++) {
+            out << "devs_events_total{kind=\"" << kindName(kind) << "\"} " << events[kind] << "\n";
+        }
+
+        out << "# TYPE devs_queue_length gauge\n"
+            << "devs_queue_length " << queueLength << "\n"
+            << "# TYPE devs_queue_length_max gauge\n"
+            << "devs_queue_length_max " << maxQueueLength << "\n"
+            << "# TYPE devs_queue_schedules_total counter\n"
+            << "devs_queue_schedules_total " << schedules << "\n"
+            << "# TYPE devs_queue_schedule_seconds_total counter\n"
+            << "devs_queue_schedule_seconds_total " << scheduleNanoseconds * 1e-9 << "\n"
+            << "# TYPE devs_queue_pop_seconds_total counter\n"
+            << "devs_queue_pop_seconds_total " << popNanoseconds * 1e-9 << "\n"
+            << "# TYPE devs_model_calls_total counter\n";
+
+        for (std::size_t id = 0; id < models.size(); id++) {
+            for (std::size_t phase = 0; phase < 4; phase++) {
+                out << "devs_model_calls_total{model=\"" << id << "\",phase=\"" << phaseName(phase) << "\"} " << models[id].calls[phase] << "\n";
+            }
+        }
+
+        out << "# TYPE devs_model_seconds_total counter\n";
+
+        for (std::size_t id = 0; id < models.size(); id++) {
+            for (std::size_t phase = 0; phase < 4; phase++) {
+                out << "devs_model_seconds_total{model=\"" << id << "\",phase=\"" << phaseName(phase) << "\"} " << models[id].nanoseconds[phase] * 1e-9 << "\n";
+            }
+        }
+
+        return out.str();
+    }
+};
+#else
+class Instrumentation {
+public:
+    struct Stamp {};
+
+    void resize(std::size_t) {}
+
+    Stamp start() const {
+        return Stamp();
+    }
+
+    void recordModel(std::size_t, Phase, Stamp) {}
+    void recordSchedule(Stamp, std::size_t = 1) {}
+    void recordPop(Stamp) {}
+    void recordStep(EventSpan, std::size_t) {}
+};
+#endif
+
+// How closely a paced run kept to its schedule. Lateness is how long after
+// its deadline a step was taken, in seconds; a step beyond the tolerance
+// missed its deadline.
+struct PacingStatistics {
+    std::uint64_t steps = 0;
+    std::uint64_t missedDeadlines = 0;
+    double totalLateness = 0.0;
+    double worstLateness = 0.0;
+
+    double getMeanLateness() const {
+        return steps == 0 ? 0.0 : totalLateness / steps;
+    }
+};
+
+class Simulator {
+private:
+    friend class ConservativeSimulator;
+    friend class OptimisticSimulator;
+
+    // A connection from an output port to an input port. A null source is
+    // the simulator's input and a null destination its output, unless a
+    // channel carries the output to another logical process.
+    struct Coupling {
+        SimulationModel* source;
+        PortId sourcePort;
+        SimulationModel* destination;
+        PortId destinationPort;
+        Channel* channel;
+    };
+
+    struct Route {
+        SimulationModel* destination;
+        PortId port;
+        Channel* channel;
+    };
+
+    EventPool pool;
+    EventQueue queue;
+    std::multimap<double, Message> inputs;
+    std::vector<InputSource*> inputSources;
+
+    // The next input of each source not yet in the queue; the inputs given
+    // with addInput() form the first source.
+    struct PendingInput {
+        InputSource* source;
+        double r;
+        Message input;
+    };
+
+    std::unique_ptr<InputSource> addedInputs;
+    std::vector<PendingInput> pendingInputs;
+
+    std::uint64_t eventCount = 0;
+    Instrumentation instrumentation;
+
+    // Set once a run has been started, by any of the run calls or by
+    // resuming from a checkpoint, so that later calls carry on with it.
+    bool isStarted = false;
+    std::vector<SimulationModel*> models;
+    std::vector<Coupling> couplings;
+    std::vector<Channel*> boundaryInputs;
+    std::vector<Channel*> boundaryOutputs;
+
+    // Outputs of the simulator, or, when run as a logical process, the
+    // same lines each stamped with the time of the step that emitted them.
+    std::stringstream trace;
+    std::vector<std::pair<Time, std::string>>* timedTrace = nullptr;
+    std::vector<LoggedInput>* inputLog = nullptr;
+    OutputSink* outputSink = nullptr;
+    BinaryTraceWriter* traceWriter = nullptr;
+
+    // Per-step state, touched only for models that are active in the step.
+    // Imminent model i emitted stepOutputs[outputOffsets[i]] up to
+    // stepOutputs[outputOffsets[i + 1]].
+    std::vector<SimulationModel*> imminent;
+    std::vector<std::size_t> outputOffsets;
+    MessageBag stepOutputs;
+
+    // Routing frozen from the couplings before a run. The routes of output
+    // port p of the model with id i are routes[routeOffsets[k]] up to
+    // routes[routeOffsets[k + 1]], where k = portOffsets[i] + p.
+    std::vector<std::size_t> portOffsets;
+    std::vector<std::size_t> routeOffsets;
+    std::vector<Route> routes;
+    std::vector<Route> inputRoutes;
+    bool routesAreBuilt = false;
+
+    // Messages sent on each output port, indexed as portOffsets, for
+    // partitioning by observed traffic.
+    std::vector<std::uint64_t> portTraffic;
+
+    // Parallel step mode: steps with at least parallelThreshold events run
+    // their lambda and transition phases on the thread pool.
+    static const std::size_t PARALLEL_GRAIN = 16;
+
+    std::unique_ptr<ThreadPool> threadPool;
+    std::size_t parallelThreshold = 0;
+    std::vector<MessageBag> imminentOutputs;
+    std::vector<std::size_t> groupOf;
+    std::vector<std::size_t> groupStarts;
+    std::vector<std::size_t> groupedEvents;
+
+    // Paced runs: inputs injected from other threads, and how the run waits
+    // for each deadline.
+    typedef std::chrono::steady_clock WallClock;
+
+    InputInbox inbox;
+    std::atomic<bool> isStopRequested{ false };
+    std::chrono::nanoseconds spinTime = std::chrono::microseconds(200);
+    std::chrono::nanoseconds deadlineTolerance = std::chrono::microseconds(100);
+    PacingStatistics pacing;
+
+    void addCoupling(SimulationModel* source, PortId sourcePort, SimulationModel* destination, PortId destinationPort, Channel* channel) {
+        couplings.push_back({ source, sourcePort, destination, destinationPort, channel });
+        routesAreBuilt = false;
+    }
+
+    // Couples every atomic output port behind from to every atomic input
+    // port behind to.
+    void addCouplings(const CoupledModel::Endpoint& from, const CoupledModel::Endpoint& to) {
+        CoupledModel::AtomicPorts sources;
+        CoupledModel::AtomicPorts destinations;
+        CoupledModel::collectSources(from, sources);
+        CoupledModel::collectDestinations(to, destinations);
+
+        for (const auto& source : sources) {
+            for (const auto& destination : destinations) {
+                addCoupling(source.first, source.second, destination.first, destination.second);
+            }
+        }
+    }
+
+    // Couplings from models that were never added are ignored, as those
+    // models' outputs are never collected.
+    void buildRoutes() {
+        std::size_t modelCount = models.size();
+        std::vector<std::size_t> portCounts(modelCount, 1);
+
+        for (SimulationModel* model : models) {
+            portCounts[model->id] = std::max<std::size_t>(1, model->outputPorts.size());
+        }
+
+        for (const Coupling& coupling : couplings) {
+            if (coupling.source != nullptr && coupling.source->id < modelCount) {
+                std::size_t& count = portCounts[coupling.source->id];
+                count = std::max<std::size_t>(count, coupling.sourcePort + 1);
+            }
+        }
+
+        portOffsets.assign(modelCount + 1, 0);
+
+        for (std::size_t i = 0; i < modelCount; i++) {
+            portOffsets[i + 1] = portOffsets[i] + portCounts[i];
+        }
+
+        routeOffsets.assign(portOffsets[modelCount] + 1, 0);
+        inputRoutes.clear();
+
+        for (const Coupling& coupling : couplings) {
+            if (coupling.source == nullptr) {
+                inputRoutes.push_back({ coupling.destination, coupling.destinationPort, nullptr });
+            }
+            else if (coupling.source->id < modelCount) {
+                routeOffsets[portOffsets[coupling.source->id] + coupling.sourcePort + 1]++;
+            }
+        }
+
+        for (std::size_t k = 1; k < routeOffsets.size(); k++) {
+            routeOffsets[k] += routeOffsets[k - 1];
+        }
+
+        routes.resize(routeOffsets.back());
+        portTraffic.assign(portOffsets[modelCount], 0);
+        std::vector<std::size_t> cursor(routeOffsets.begin(), routeOffsets.end() - 1);
+
+        for (const Coupling& coupling : couplings) {
+            if (coupling.source != nullptr && coupling.source->id < modelCount) {
+                std::size_t k = portOffsets[coupling.source->id] + coupling.sourcePort;
+                routes[cursor[k]++] = { coupling.destination, coupling.destinationPort, coupling.channel };
+            }
+        }
+
+        routesAreBuilt = true;
+    }
+
+    void deliver(const Message& output, double r, const SimulationModel* source, const Route* first, const Route* last) {
+        for (const Route* route = first; route != last; route++) {
+            if (route->channel != nullptr) {
+                const Time& now = queue.currentTime();
+                route->channel->send(Time(now.getR(), now.getC() + 1), output);
+            }
+            else if (route->destination == nullptr && timedTrace != nullptr) {
+                std::stringstream line;
+                line << r << " - " << output << "\n";
+                timedTrace->emplace_back(queue.currentTime(), line.str());
+            }
+            else if (route->destination == nullptr) {
+                if (traceWriter != nullptr) {
+                    traceWriter->write(queue.currentTime(), source->id, TraceKind::Output, output);
+                }
+
+                if (outputSink != nullptr) {
+                    outputSink->write(r, output);
+                }
+                else if (traceWriter == nullptr) {
+                    trace << r << " - " << output << "\n";
+                }
+            }
+            else {
+                Instrumentation::Stamp started = instrumentation.start();
+                queue.batchExternalEvent(output, route->port, r, route->destination);
+                instrumentation.recordSchedule(started);
+
+                if (inputLog != nullptr) {
+                    const Time& now = queue.currentTime();
+                    inputLog->push_back({ Time(now.getR(), now.getC() + 1), route->destination, route->port, output, nullptr, 0, true });
+                }
+            }
+        }
+    }
+
+    // Only the imminent models (internal or confluent events) emit output;
+    // the influenced ones (external events) just transition.
+    void computeOutputs(EventSpan events) {
+        for (const Event& event : events) {
+            if (event.getKind() != EventKind::External) {
+                SimulationModel* model = event.getModel();
+
+                Instrumentation::Stamp started = instrumentation.start();
+                model->randomStream.beginCall();
+                model->lambda(stepOutputs);
+                instrumentation.recordModel(model->id, Phase::Lambda, started);
+                imminent.push_back(model);
+                outputOffsets.push_back(stepOutputs.size());
+            }
+        }
+    }
+
+    // Each imminent model writes to its own bag; the bags are then appended
+    // in event order so the outputs come out exactly as in a serial step.
+    void computeOutputsInParallel(EventSpan events) {
+        for (const Event& event : events) {
+            if (event.getKind() != EventKind::External) {
+                imminent.push_back(event.getModel());
+            }
+        }
+
+        if (imminentOutputs.size() < imminent.size()) {
+            imminentOutputs.resize(imminent.size());
+        }
+
+        threadPool->parallelFor(imminent.size(), PARALLEL_GRAIN, [this](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                imminentOutputs[i].clear();
+
+                Instrumentation::Stamp started = instrumentation.start();
+                imminent[i]->randomStream.beginCall();
+                imminent[i]->lambda(imminentOutputs[i]);
+                instrumentation.recordModel(imminent[i]->id, Phase::Lambda, started);
+            }
+        });
+
+        for (std::size_t i = 0; i < imminent.size(); i++) {
+            for (Message& output : imminentOutputs[i]) {
+                stepOutputs.push_back(std::move(output));
+            }
+
+            outputOffsets.push_back(stepOutputs.size());
+        }
+    }
+
+    // Events for models of this simulator are batched, and merged into the
+    // queue once the whole step is routed.
+    void routeOutputs(double r) {
+        for (std::size_t i = 0; i < imminent.size(); i++) {
+            std::size_t id = imminent[i]->id;
+
+            for (std::size_t j = outputOffsets[i]; j < outputOffsets[i + 1]; j++) {
+                const Message& output = stepOutputs[j];
+
+                if (id >= models.size() || output.getPort() >= portOffsets[id + 1] - portOffsets[id]) {
+                    continue;
+                }
+
+                std::size_t k = portOffsets[id] + output.getPort();
+                portTraffic[k]++;
+
+                deliver(output, r, imminent[i], routes.data() + routeOffsets[k], routes.data() + routeOffsets[k + 1]);
+            }
+        }
+
+        Instrumentation::Stamp started = instrumentation.start();
+        queue.scheduleBatch();
+        instrumentation.recordSchedule(started, 0);
+    }
+
+    void applyTransition(const Event& event) {
+        SimulationModel* model = event.getModel();
+        Instrumentation::Stamp started = instrumentation.start();
+        model->randomStream.beginCall();
+
+        switch (event.getKind()) {
+        case EventKind::Internal:
+            model->deltaInt(event.getTime().getR());
+            instrumentation.recordModel(model->id, Phase::DeltaInt, started);
+            break;
+        case EventKind::External:
+            model->isTimeAdvanceKept = false;
+            model->deltaExt(queue.getInput(event), event.getTime().getR());
+            model->keepsTimeAdvance = model->keepsTimeAdvance && model->isTimeAdvanceKept;
+            instrumentation.recordModel(model->id, Phase::DeltaExt, started);
+            break;
+        case EventKind::Confluent:
+            model->deltaCon(queue.getInput(event), event.getTime().getR());
+            instrumentation.recordModel(model->id, Phase::DeltaCon, started);
+            break;
+        }
+    }
+
+    // A model may have several events in one step; they are grouped so that
+    // each model's transitions run in order on a single thread.
+    void applyTransitionsInParallel(EventSpan events) {
+        const std::size_t unassigned = std::numeric_limits<std::size_t>::max();
+
+        // Models that were never added share the last slot and so one group.
+        groupOf.resize(models.size() + 1, unassigned);
+        groupStarts.assign(1, 0);
+
+        std::vector<std::size_t> groupSizes;
+
+        for (const Event& event : events) {
+            std::size_t id = std::min(event.getModel()->id, models.size());
+
+            if (groupOf[id] == unassigned) {
+                groupOf[id] = groupSizes.size();
+                groupSizes.push_back(0);
+            }
+
+            groupSizes[groupOf[id]]++;
+        }
+
+        for (std::size_t size : groupSizes) {
+            groupStarts.push_back(groupStarts.back() + size);
+        }
+
+        groupedEvents.resize(events.size());
+        std::vector<std::size_t> cursor(groupStarts.begin(), groupStarts.end() - 1);
+
+        for (std::size_t i = 0; i < events.size(); i++) {
+            groupedEvents[cursor[groupOf[std::min(events[i].getModel()->id, models.size())]]++] = i;
+        }
+
+        for (const Event& event : events) {
+            groupOf[std::min(event.getModel()->id, models.size())] = unassigned;
+        }
+
+        threadPool->parallelFor(groupSizes.size(), PARALLEL_GRAIN, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t group = begin; group < end; group++) {
+                for (std::size_t j = groupStarts[group]; j < groupStarts[group + 1]; j++) {
+                    applyTransition(events[groupedEvents[j]]);
+                }
+            }
+        });
+    }
+
+    void scheduleInput(double r, const Message& input) {
+        if (r < queue.currentTime().getR()) {
+            throw std::runtime_error("inputs must come in time order");
+        }
+
+        for (const Route& route : inputRoutes) {
+            Instrumentation::Stamp started = instrumentation.start();
+            queue.scheduleExternalEvent(input, route.port, r, route.destination);
+            instrumentation.recordSchedule(started);
+
+            if (inputLog != nullptr) {
+                inputLog->push_back({ Time(r, 0), route.destination, route.port, input, nullptr, 0, false });
+            }
+        }
+    }
+
+    InputSource* sourceAt(std::size_t i) const {
+        return i == 0 ? addedInputs.get() : inputSources[i - 1];
+    }
+
+    void openInputs() {
+        addedInputs.reset(new IteratorSource<std::multimap<double, Message>::const_iterator>(inputs.begin(), inputs.end()));
+        pendingInputs.clear();
+
+        PendingInput pending = { addedInputs.get(), 0.0, Message() };
+
+        if (pending.source->next(pending.r, pending.input)) {
+            pendingInputs.push_back(pending);
+        }
+
+        for (InputSource* source : inputSources) {
+            pending.source = source;
+
+            if (source->next(pending.r, pending.input)) {
+                pendingInputs.push_back(pending);
+            }
+        }
+    }
+
+    // Queues every pending input due no later than the next step, so that
+    // only the first input of each source beyond it is held back.
+    // Inputs with nowhere to go are dropped, sources and all, so that an
+    // unbounded source without an input coupling cannot spin forever.
+    void pullInputs() {
+        if (inputRoutes.empty()) {
+            pendingInputs.clear();
+            return;
+        }
+
+        for (std::size_t i = 0; i < pendingInputs.size();) {
+            PendingInput& pending = pendingInputs[i];
+            bool isExhausted = false;
+
+            // Compared as times, which fixed-point builds round to ticks.
+            while (queue.isEmpty() || Time(pending.r, 0).getR() <= queue.timeAdvance()) {
+                scheduleInput(pending.r, pending.input);
+
+                if (!pending.source->next(pending.r, pending.input)) {
+                    isExhausted = true;
+                    break;
+                }
+            }
+
+            if (isExhausted) {
+                pendingInputs.erase(pendingInputs.begin() + i);
+            }
+            else {
+                i++;
+            }
+        }
+    }
+
+    // What a checkpoint has to be restored into: the number of models and
+    // the couplings between them.
+    std::string getLayout() const {
+        StateBuffer layout;
+        layout.write(static_cast<std::uint64_t>(models.size()));
+        layout.write(static_cast<std::uint64_t>(couplings.size()));
+
+        for (const Coupling& coupling : couplings) {
+            layout.write(static_cast<std::uint64_t>(coupling.source == nullptr ? NO_MODEL : coupling.source->id));
+            layout.write(coupling.sourcePort);
+            layout.write(static_cast<std::uint64_t>(coupling.destination == nullptr ? NO_MODEL : coupling.destination->id));
+            layout.write(coupling.destinationPort);
+        }
+
+        layout.write(static_cast<std::uint64_t>(inputSources.size()));
+
+        return std::string(reinterpret_cast<const char*>(layout.data()), layout.size());
+    }
+
+    // Schedules what has been injected at time r, or at the current time if
+    // the run has already gone past r.
+    void takeInjectedInputs(double r) {
+        Message input;
+
+        while (inbox.pop(input)) {
+            scheduleInput(std::max(r, queue.currentTime().getR()), input);
+        }
+    }
+
+    // Sleeps while the deadline is more than the spin time away, in naps no
+    // longer than the spin time, then spins. Returns false if an input was
+    // injected or the run stopped before the deadline. A run with no
+    // deadline waits only for those.
+    bool waitUntil(WallClock::time_point deadline, bool hasDeadline) {
+        while (true) {
+            if (isStopRequested.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            if (!inbox.isEmpty()) {
+                return false;
+            }
+
+            WallClock::duration remaining = deadline - WallClock::now();
+
+            if (hasDeadline && remaining <= WallClock::duration::zero()) {
+                return true;
+            }
+
+            if (!hasDeadline || remaining > spinTime) {
+                std::this_thread::sleep_for(hasDeadline ? std::min<WallClock::duration>(remaining - spinTime, spinTime) : spinTime);
+            }
+        }
+    }
+
+    void start() {
+        if (!routesAreBuilt) {
+            buildRoutes();
+        }
+
+        openInputs();
+        scheduleInitialEvents();
+        isStarted = true;
+    }
+
+    // Models due to act before any input, e.g. generators, are asked for
+    // their first internal event as the run starts.
+    void scheduleInitialEvents() {
+        for (SimulationModel* model : models) {
+            if (model->internalEvent == NO_EVENT) {
+                double nextInternalEvent = model->getNextInternalEvent();
+
+                if (nextInternalEvent < std::numeric_limits<double>::infinity()) {
+                    queue.scheduleInternalEvent(nextInternalEvent, model);
+                }
+            }
+        }
+    }
+
+    // Moves the event storage to the calling thread's NUMA node.
+    void relocate() {
+        pool.relocate();
+        queue.relocate();
+        NumaTopology::relocate(routes);
+        NumaTopology::relocate(stepOutputs);
+    }
+
+    // Takes the events at the earliest time off the queue and runs them.
+    void takeStep() {
+        Instrumentation::Stamp started = instrumentation.start();
+        EventSpan events = queue.getNextEvents();
+        instrumentation.recordPop(started);
+
+        process(events);
+    }
+
+    void process(EventSpan events) {
+        double r = events.front().getTime().getR();
+        eventCount += events.size();
+
+        if (traceWriter != nullptr) {
+            for (const Event& event : events) {
+                // TraceKind lists the event kinds first, in the same order.
+                TraceKind kind = static_cast<TraceKind>(event.getKind());
+                traceWriter->write(event.getTime(), event.getModel()->id, kind, event.getKind() == EventKind::Internal ? Message() : queue.getInput(event));
+            }
+        }
+
+        bool parallel = threadPool != nullptr && events.size() >= parallelThreshold;
+
+        clearOutputs();
+
+        if (parallel) {
+            computeOutputsInParallel(events);
+        }
+        else {
+            computeOutputs(events);
+        }
+
+        routeOutputs(r);
+
+        if (parallel) {
+            applyTransitionsInParallel(events);
+        }
+        else {
+            for (const Event& event : events) {
+                applyTransition(event);
+            }
+        }
+
+        scheduleNextEvents(events);
+
+        for (const Event& event : events) {
+            pool.releaseInput(event.getInput());
+        }
+
+        instrumentation.recordStep(events, queue.size());
+    }
+
+    // Runs after every transition of the step, in event order, so the queue
+    // is only ever touched from the simulation thread. Each model is asked
+    // once, and not at all if it kept its time advance through inputs alone.
+    void scheduleNextEvents(EventSpan events) {
+        for (const Event& event : events) {
+            SimulationModel* model = event.getModel();
+
+            if (model->isRescheduled || (model->keepsTimeAdvance && !std::isnan(model->scheduledTime))) {
+                model->isRescheduled = true;
+                continue;
+            }
+
+            model->isRescheduled = true;
+
+            double nextInternalEvent = model->getNextInternalEvent();
+            Instrumentation::Stamp started = instrumentation.start();
+
+            if (nextInternalEvent != model->scheduledTime) {
+                if (nextInternalEvent < std::numeric_limits<double>::infinity()) {
+                    queue.scheduleInternalEvent(nextInternalEvent, model);
+                }
+                else {
+                    queue.cancelInternalEvent(model);
+                }
+            }
+
+            instrumentation.recordSchedule(started);
+        }
+
+        for (const Event& event : events) {
+            event.getModel()->isRescheduled = false;
+            event.getModel()->keepsTimeAdvance = true;
+        }
+    }
+
+public:
+    Simulator() : queue(pool) {}
+
+    Simulator(std::unique_ptr<EventQueueBackend> backend) : queue(pool, std::move(backend)) {}
+
+    // Schedules every input up front, as the logical-process engines need.
+    // The sources of a model with input couplings must therefore end: an
+    // unbounded one never returns. Sources of a model without any are
+    // dropped unread.
+    void scheduleEvents() {
+        openInputs();
+        scheduleInitialEvents();
+
+        for (PendingInput& pending : pendingInputs) {
+            if (inputRoutes.empty()) {
+                break;
+            }
+
+            do {
+                scheduleInput(pending.r, pending.input);
+            } while (pending.source->next(pending.r, pending.input));
+        }
+
+        pendingInputs.clear();
+    }
+
+    // Inputs at the same time are all delivered, in the order added.
+    // Inputs added once the run has started are queued right away, and must
+    // not be earlier than where it stands.
+    void addInput(const Message& input, double r) {
+        if (isStarted) {
+            scheduleInput(r, input);
+            return;
+        }
+
+        inputs.emplace(r, input);
+    }
+
+    // Pulls inputs from source as the run goes; the source must outlive it.
+    // The logical-process engines read every input up front, so theirs must
+    // end.
+    void addInputSource(InputSource* source) {
+        inputSources.push_back(source);
+    }
+
+    void addModel(SimulationModel* m) {
+        if (m->id < models.size() && models[m->id] == m) {
+            return;
+        }
+
+        m->id = models.size();
+        models.push_back(m);
+
+        if (!m->randomStream.isSet) {
+            m->randomStream.setStream(0, static_cast<std::uint32_t>(m->id));
+        }
+
+        instrumentation.resize(models.size());
+        routesAreBuilt = false;
+    }
+
+    // An output port may be coupled to any number of input ports, and an
+    // input port may be fed by any number of output ports.
+    void addCoupling(SimulationModel* m1, SimulationModel* m2) {
+        addCoupling(m1, 0, m2, 0);
+    }
+
+    // Ports by number, e.g. the lanes of a ModelArray.
+    void addCoupling(SimulationModel* m1, PortId outputPort, SimulationModel* m2, PortId inputPort) {
+        addCoupling(m1, outputPort, m2, inputPort, nullptr);
+    }
+
+    void addCoupling(SimulationModel* m1, const std::string& outputPort, SimulationModel* m2, const std::string& inputPort) {
+        addCoupling(m1, m1->getOutputPort(outputPort), m2, m2->getInputPort(inputPort));
+    }
+
+    void routeInputTo(SimulationModel* m) {
+        addCoupling(nullptr, 0, m, 0);
+    }
+
+    void routeInputTo(SimulationModel* m, const std::string& inputPort) {
+        addCoupling(nullptr, 0, m, m->getInputPort(inputPort));
+    }
+
+    void takeOutputFrom(SimulationModel* m) {
+        addCoupling(m, 0, nullptr, 0);
+    }
+
+    void takeOutputFrom(SimulationModel* m, const std::string& outputPort) {
+        addCoupling(m, m->getOutputPort(outputPort), nullptr, 0);
+    }
+
+    // Adds the atomic models inside a coupled model, and the couplings
+    // between them resolved to direct routes.
+    void addModel(CoupledModel* m) {
+        for (SimulationModel* atomic : m->atomicModels) {
+            addModel(atomic);
+        }
+
+        for (CoupledModel* coupled : m->coupledModels) {
+            addModel(coupled);
+        }
+
+        for (const CoupledModel::Link& link : m->internalLinks) {
+            addCouplings(link.from, link.to);
+        }
+    }
+
+    // Couplings to and from coupled models; either side may also be atomic.
+    template <typename From, typename To>
+    void addCoupling(From* m1, const std::string& outputPort, To* m2, const std::string& inputPort) {
+        addCouplings(CoupledModel::outputOf(m1, outputPort), CoupledModel::inputOf(m2, inputPort));
+    }
+
+    void routeInputTo(CoupledModel* m, const std::string& inputPort = "in") {
+        CoupledModel::AtomicPorts destinations;
+        CoupledModel::collectDestinations(CoupledModel::inputOf(m, inputPort), destinations);
+
+        for (const auto& destination : destinations) {
+            addCoupling(nullptr, 0, destination.first, destination.second);
+        }
+    }
+
+    void takeOutputFrom(CoupledModel* m, const std::string& outputPort = "out") {
+        CoupledModel::AtomicPorts sources;
+        CoupledModel::collectSources(CoupledModel::outputOf(m, outputPort), sources);
+
+        for (const auto& source : sources) {
+            addCoupling(source.first, source.second, nullptr, 0);
+        }
+    }
+
+    // Marks a coupling as crossing into another logical process: outputs of
+    // the port are sent over the channel instead of scheduled here.
+    void addBoundaryCoupling(SimulationModel* m, const std::string& outputPort, Channel* channel) {
+        addBoundaryCoupling(m, m->getOutputPort(outputPort), channel);
+    }
+
+    void addBoundaryCoupling(SimulationModel* m, PortId outputPort, Channel* channel) {
+        addCoupling(m, outputPort, nullptr, 0, channel);
+        boundaryOutputs.push_back(channel);
+    }
+
+    // Takes the messages of a channel from another logical process as input
+    // to the channel's destination, which must be a model of this simulator.
+    void addBoundaryInput(Channel* channel) {
+        boundaryInputs.push_back(channel);
+    }
+
+    // Messages sent on each coupling over the runs so far, in the order the
+    // couplings were added; zero before the first run.
+    std::vector<std::uint64_t> getCouplingTraffic() const {
+        std::vector<std::uint64_t> traffic(couplings.size(), 0);
+
+        for (std::size_t i = 0; i < couplings.size(); i++) {
+            const Coupling& coupling = couplings[i];
+
+            if (routesAreBuilt && coupling.source != nullptr && coupling.source->id < portOffsets.size() - 1) {
+                std::size_t k = portOffsets[coupling.source->id] + coupling.sourcePort;
+
+                if (k < portOffsets[coupling.source->id + 1]) {
+                    traffic[i] = portTraffic[k];
+                }
+            }
+        }
+
+        return traffic;
+    }
+
+    // Assigns every model, by the order it was added, to one of parts
+    // logical processes so as to cut the fewest messages between them,
+    // weighting each coupling by its traffic so far and each model by the
+    // messages it handles. Couplings never used count as one message, so a
+    // simulator that has not run is split by its structure alone.
+    std::vector<std::size_t> partitionModels(std::size_t parts, double imbalance = 0.03) const {
+        GraphPartitioner graph(models.size());
+        std::vector<double> load(models.size(), 1.0);
+        std::vector<std::uint64_t> traffic = getCouplingTraffic();
+
+        for (std::size_t i = 0; i < couplings.size(); i++) {
+            const Coupling& coupling = couplings[i];
+
+            if (coupling.source == nullptr || coupling.destination == nullptr) {
+                continue;
+            }
+
+            double weight = static_cast<double>(std::max<std::uint64_t>(traffic[i], 1));
+            graph.addEdge(coupling.source->id, coupling.destination->id, weight);
+            load[coupling.source->id] += weight;
+            load[coupling.destination->id] += weight;
+        }
+
+        for (std::size_t id = 0; id < models.size(); id++) {
+            graph.setVertexWeight(id, load[id]);
+        }
+
+        return graph.partition(parts, imbalance);
+    }
+
+    // A core for each of the logical processes of an assignment. Processes
+    // that exchange the most messages are put on the same NUMA node, nodes
+    // getting processes in proportion to their cores, and the processes of
+    // a node take its cores in turn.
+    std::vector<int> placePartitions(const std::vector<std::size_t>& assignment, const NumaTopology& topology = NumaTopology::detect()) const {
+        std::size_t parts = 0;
+
+        for (std::size_t part : assignment) {
+            parts = std::max(parts, part + 1);
+        }
+
+        const std::vector<std::vector<int>>& nodes = topology.getNodes();
+        GraphPartitioner graph(parts);
+        std::vector<std::uint64_t> traffic = getCouplingTraffic();
+
+        for (std::size_t i = 0; i < couplings.size(); i++) {
+            const Coupling& coupling = couplings[i];
+
+            if (coupling.source != nullptr && coupling.destination != nullptr) {
+                graph.addEdge(assignment.at(coupling.source->id), assignment.at(coupling.destination->id),
+                    static_cast<double>(std::max<std::uint64_t>(traffic[i], 1)));
+            }
+        }
+
+        std::vector<double> shares;
+
+        for (const std::vector<int>& node : nodes) {
+            shares.push_back(static_cast<double>(node.size()));
+        }
+
+        std::vector<std::size_t> nodeOf = nodes.size() == 1 ? std::vector<std::size_t>(parts, 0) : graph.partition(shares);
+        std::vector<std::size_t> used(nodes.size(), 0);
+        std::vector<int> cores(parts);
+
+        for (std::size_t part = 0; part < parts; part++) {
+            const std::vector<int>& node = nodes[nodeOf[part]];
+            cores[part] = node[used[nodeOf[part]]++ % node.size()];
+        }
+
+        return cores;
+    }
+
+    // Splits the models of this simulator across new logical processes of
+    // engine, model i going to process assignment[i]. Couplings within a
+    // process stay direct and the rest become boundary couplings; inputs,
+    // input sources and outputs are carried over. The models then belong to
+    // the engine's processes, so this simulator is not to be run again.
+    template <typename Engine>
+    std::vector<Simulator*> distributeTo(Engine& engine, const std::vector<std::size_t>& assignment) const {
+        if (assignment.size() != models.size()) {
+            throw std::invalid_argument("the assignment must give a process for every model");
+        }
+
+        std::size_t parts = 0;
+
+        for (std::size_t part : assignment) {
+            parts = std::max(parts, part + 1);
+        }
+
+        // Processes of the ends of every coupling, taken before adding the
+        // models elsewhere gives them new ids.
+        std::vector<std::pair<std::size_t, std::size_t>> ends;
+
+        for (const Coupling& coupling : couplings) {
+            if (coupling.channel != nullptr) {
+                throw std::logic_error("a simulator with boundary couplings cannot be distributed");
+            }
+
+            ends.emplace_back(coupling.source == nullptr ? NO_MODEL : assignment.at(coupling.source->id),
+                coupling.destination == nullptr ? NO_MODEL : assignment.at(coupling.destination->id));
+        }
+
+        std::vector<Simulator*> partitions;
+
+        for (std::size_t part = 0; part < parts; part++) {
+            partitions.push_back(&engine.addPartition());
+        }
+
+        for (std::size_t i = 0; i < models.size(); i++) {
+            partitions[assignment[i]]->addModel(models[i]);
+        }
+
+        std::vector<char> takesInput(parts, 0);
+
+        for (std::size_t i = 0; i < couplings.size(); i++) {
+            const Coupling& coupling = couplings[i];
+            std::size_t from = ends[i].first;
+            std::size_t to = ends[i].second;
+
+            if (from == NO_MODEL) {
+                partitions[to]->addCoupling(nullptr, 0, coupling.destination, coupling.destinationPort);
+                takesInput[to] = 1;
+            }
+            else if (to == NO_MODEL) {
+                partitions[from]->addCoupling(coupling.source, coupling.sourcePort, nullptr, 0);
+            }
+            else if (from == to) {
+                partitions[from]->addCoupling(coupling.source, coupling.sourcePort, coupling.destination, coupling.destinationPort);
+            }
+            else {
+                engine.addBoundaryCoupling(*partitions[from], coupling.source, coupling.sourcePort, *partitions[to], coupling.destination, coupling.destinationPort);
+            }
+        }
+
+        // A source can only be read by one process.
+        if (!inputSources.empty() && std::count(takesInput.begin(), takesInput.end(), 1) > 1) {
+            throw std::logic_error("input sources can only be distributed to a single process");
+        }
+
+        for (std::size_t part = 0; part < parts; part++) {
+            if (!takesInput[part]) {
+                continue;
+            }
+
+            partitions[part]->inputs = inputs;
+
+            for (InputSource* source : inputSources) {
+                partitions[part]->addInputSource(source);
+            }
+        }
+
+        return partitions;
+    }
+
+    // Sizes the event pool up front, e.g. from the high-water mark of an
+    // earlier run.
+    void reserveEvents(std::size_t n) {
+        pool.reserve(n);
+    }
+
+    std::size_t getEventHighWaterMark() const {
+        return pool.getHighWaterMark();
+    }
+
+    // Events run over the simulator's lifetime.
+    std::uint64_t getEventCount() const {
+        return eventCount;
+    }
+
+    // Hot-path counters and per-model timings; they only count anything,
+    // and can only be exported with toJson() and toPrometheus(), in builds
+    // that define DEVS_INSTRUMENTATION.
+    const Instrumentation& getInstrumentation() const {
+        return instrumentation;
+    }
+
+    // Runs steps of at least threshold events on the given number of
+    // threads; one thread turns parallel stepping off again. Outputs and
+    // scheduling stay in event order, so results match a serial run.
+    void setParallelism(std::size_t threads, std::size_t threshold = 64) {
+        threadPool.reset(threads > 1 ? new ThreadPool(threads) : nullptr);
+        parallelThreshold = threshold;
+    }
+
+    // Streams outputs to sink as they are produced; simulate() then returns
+    // an empty trace. A null sink goes back to collecting the trace.
+    void setOutputSink(OutputSink* sink) {
+        outputSink = sink;
+    }
+
+    // Records every event and output of the run in writer. Outputs then go
+    // to the writer instead of the returned trace; a sink still gets them.
+    void setTraceWriter(BinaryTraceWriter* writer) {
+        traceWriter = writer;
+    }
+
+    void clearOutputs() {
+        imminent.clear();
+        outputOffsets.assign(1, 0);
+        stepOutputs.clear();
+    }
+
+    std::string simulate() {
+        return simulateUntil(std::numeric_limits<double>::infinity());
+    }
+
+    // Runs every step before time r and returns their outputs. The run can
+    // then be checkpointed, or carried on by any of the run calls.
+    std::string simulateUntil(double r) {
+        runUntil(Time(r, 0));
+
+        return takeOutputs();
+    }
+
+    // Incremental control: each call starts the run if need be and carries
+    // on from where the last one stopped, with the queue and the models as
+    // they were left. Outputs collect until takeOutputs().
+
+    // Takes one step; false once nothing is left to run.
+    bool step() {
+        if (!isStarted) {
+            start();
+        }
+
+        pullInputs();
+
+        if (queue.isEmpty()) {
+            return false;
+        }
+
+        takeStep();
+
+        return true;
+    }
+
+    // Takes every step before time; false once nothing is left to run.
+    bool runUntil(const Time& time) {
+        if (!isStarted) {
+            start();
+        }
+
+        while (true) {
+            pullInputs();
+
+            if (queue.isEmpty()) {
+                return false;
+            }
+
+            if (!(queue.nextEventTime() < time)) {
+                return true;
+            }
+
+            takeStep();
+        }
+    }
+
+    // Takes whole steps until at least count events have run, and returns
+    // how many did.
+    std::uint64_t runEvents(std::uint64_t count) {
+        std::uint64_t first = eventCount;
+
+        while (eventCount - first < count && step()) {}
+
+        return eventCount - first;
+    }
+
+    // The outputs since the last call, with the sink flushed.
+    std::string takeOutputs() {
+        if (outputSink != nullptr) {
+            outputSink->flush();
+        }
+
+        std::string result = trace.str();
+        trace.str("");
+
+        return result;
+    }
+
+    // Runs in step with the steady clock: a step at r is taken once
+    // secondsPerUnit * (r - r0) seconds have passed since the call, r0 being
+    // where the run stood, and steps that fall behind are taken at once.
+    // Inputs can be injected from other threads while it runs. The run ends
+    // before time r, or on stop(); until then an empty queue waits for
+    // injected inputs.
+    std::string simulateRealTime(double secondsPerUnit, double r = std::numeric_limits<double>::infinity()) {
+        if (!(secondsPerUnit > 0.0)) {
+            throw std::invalid_argument("a paced run needs a positive number of seconds per unit");
+        }
+
+        if (!isStarted) {
+            start();
+        }
+
+        double origin = std::max(queue.currentTime().getR(), 0.0);
+        WallClock::time_point started = WallClock::now();
+        pacing = PacingStatistics();
+
+        auto deadlineOf = [&](double time) {
+            return started + std::chrono::duration_cast<WallClock::duration>(std::chrono::duration<double>((time - origin) * secondsPerUnit));
+        };
+
+        while (!isStopRequested.load(std::memory_order_acquire)) {
+            takeInjectedInputs(origin + std::chrono::duration<double>(WallClock::now() - started).count() / secondsPerUnit);
+            pullInputs();
+
+            double next = queue.isEmpty() ? std::numeric_limits<double>::infinity() : queue.timeAdvance();
+            double until = std::min(next, r);
+            bool hasDeadline = until < std::numeric_limits<double>::infinity();
+            WallClock::time_point deadline = hasDeadline ? deadlineOf(until) : started;
+
+            if (!waitUntil(deadline, hasDeadline)) {
+                continue;
+            }
+
+            if (next >= r) {
+                break;
+            }
+
+            double lateness = std::chrono::duration<double>(WallClock::now() - deadline).count();
+            pacing.steps++;
+            pacing.totalLateness += lateness;
+            pacing.worstLateness = std::max(pacing.worstLateness, lateness);
+
+            if (lateness > std::chrono::duration<double>(deadlineTolerance).count()) {
+                pacing.missedDeadlines++;
+            }
+
+            takeStep();
+        }
+
+        isStopRequested.store(false, std::memory_order_release);
+
+        return takeOutputs();
+    }
+
+    // Hands an input to a paced run from any thread. It arrives at the
+    // simulated time of the moment the run takes it in, on the input
+    // couplings.
+    void injectInput(const Message& input) {
+        inbox.push(input);
+    }
+
+    // Ends a paced run from any thread, after the step it is taking.
+    void stop() {
+        isStopRequested.store(true, std::memory_order_release);
+    }
+
+    // spin is how long before each deadline a paced run stops sleeping and
+    // spins; a step taken more than tolerance late missed its deadline.
+    void setPacing(std::chrono::nanoseconds spin, std::chrono::nanoseconds tolerance) {
+        spinTime = spin;
+        deadlineTolerance = tolerance;
+    }
+
+    const PacingStatistics& getPacingStatistics() const {
+        return pacing;
+    }
+
+    // Saves a run stopped by simulateUntil(): the queue with its inputs, the
+    // position of every input source and the state of every model. The
+    // couplings are recorded only to check them on restore.
+    void saveCheckpoint(const std::string& path) {
+        if (!isStarted) {
+            throw std::logic_error("no run to checkpoint");
+        }
+
+        StateBuffer state;
+        state.write(CHECKPOINT_MAGIC);
+        state.write(CHECKPOINT_VERSION);
+        state.write(getLayout());
+
+        state.write(queue.currentTime().getR());
+        state.write(queue.currentTime().getC());
+
+        std::vector<std::pair<Event, Message>> events = queue.getPendingEvents();
+        state.write(static_cast<std::uint64_t>(events.size()));
+
+        for (const auto& entry : events) {
+            const Event& event = entry.first;
+
+            if (event.getModel()->id >= models.size()) {
+                throw std::logic_error("event of a model that was never added");
+            }
+
+            state.write(event.getKind());
+            state.write(event.getTime().getR());
+            state.write(event.getTime().getC());
+            state.write(static_cast<std::uint64_t>(event.getModel()->id));
+            entry.second.saveTo(state);
+        }
+
+        state.write(static_cast<std::uint64_t>(pendingInputs.size()));
+
+        for (const PendingInput& pending : pendingInputs) {
+            std::uint64_t source = 0;
+
+            while (sourceAt(static_cast<std::size_t>(source)) != pending.source) {
+                source++;
+            }
+
+            state.write(source);
+            state.write(pending.r);
+            pending.input.saveTo(state);
+        }
+
+        for (std::size_t i = 0; i <= inputSources.size(); i++) {
+            sourceAt(i)->saveState(state);
+        }
+
+        StateBuffer modelState;
+
+        for (SimulationModel* model : models) {
+            modelState.truncate(0);
+            model->saveState(modelState);
+
+            state.write(model->randomStream.call);
+            state.write(std::string(reinterpret_cast<const char*>(modelState.data()), modelState.size()));
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(state.data()), state.size());
+
+        if (!file) {
+            throw std::runtime_error("cannot write " + path);
+        }
+    }
+
+    // Resumes a checkpointed run; simulate() then carries on from it. The
+    // simulator must have been set up as the one that saved it, with the
+    // same models, couplings, inputs and sources.
+    void restoreCheckpoint(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        StateBuffer state;
+        state.load(bytes.data(), bytes.size());
+
+        char magic[8] = {};
+        std::uint32_t version = 0;
+
+        if (bytes.size() >= sizeof(magic) + sizeof(version)) {
+            state.read(magic);
+            state.read(version);
+        }
+
+        if (std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 || version != CHECKPOINT_VERSION) {
+            throw std::runtime_error("not a checkpoint: " + path);
+        }
+
+        if (!routesAreBuilt) {
+            buildRoutes();
+        }
+
+        std::string layout;
+        state.read(layout);
+
+        if (layout != getLayout()) {
+            throw std::runtime_error("checkpoint is of a differently coupled simulator");
+        }
+
+        double r;
+        int c;
+        state.read(r);
+        state.read(c);
+
+        queue.clear();
+        queue.setCurrentTime(Time(r, c));
+
+        std::uint64_t count;
+        state.read(count);
+
+        for (std::uint64_t i = 0; i < count; i++) {
+            EventKind kind;
+            std::uint64_t model;
+
+            state.read(kind);
+            state.read(r);
+            state.read(c);
+            state.read(model);
+            queue.insert(kind, Time(r, c), models.at(static_cast<std::size_t>(model)), Message::loadFrom(state));
+        }
+
+        addedInputs.reset(new IteratorSource<std::multimap<double, Message>::const_iterator>(inputs.begin(), inputs.end()));
+        pendingInputs.clear();
+        state.read(count);
+
+        for (std::uint64_t i = 0; i < count; i++) {
+            std::uint64_t source;
+            PendingInput pending;
+
+            state.read(source);
+            state.read(pending.r);
+            pending.input = Message::loadFrom(state);
+            pending.source = sourceAt(static_cast<std::size_t>(source));
+            pendingInputs.push_back(pending);
+        }
+
+        for (std::size_t i = 0; i <= inputSources.size(); i++) {
+            sourceAt(i)->restoreState(state);
+        }
+
+        for (SimulationModel* model : models) {
+            std::uint64_t size;
+            state.read(model->randomStream.call);
+            state.read(size);
+
+            std::size_t start = state.position();
+            model->restoreState(state);
+
+            if (state.position() - start != size) {
+                throw std::runtime_error("model state in checkpoint does not match the model");
+            }
+        }
+
+        isStarted = true;
+    }
+};
+
+// Runs a model split into logical processes, each with its own simulator
+// and thread, under the Chandy-Misra-Bryant protocol. A process only takes a
+// step once every channel into it has promised that nothing earlier can
+// still arrive; after each round it sends null messages raising the clocks
+// of its own channels by their lookahead. Every cycle of channels needs a
+// positive lookahead somewhere, or the processes on it can only creep
+// forward one micro-step at a time. Results match a single simulator's,
+// except that simultaneous messages from different processes, be they
+// inputs to one model or lines of the merged output, may be ordered
+// differently.
+class ConservativeSimulator {
+private:
+    struct Partition {
+        std::unique_ptr<Simulator> simulator;
+        WakeSignal signal;
+        std::vector<std::pair<Time, std::string>> trace;
+        bool idle = false;
+    };
+
+    std::vector<std::unique_ptr<Partition>> partitions;
+    std::vector<std::unique_ptr<Channel>> channels;
+    std::vector<int> cores;
+
+    // The run ends once every process is out of events with no message in
+    // flight; with cycles the clocks alone never get there.
+    std::mutex idleMutex;
+    std::size_t idleCount = 0;
+    std::atomic<bool> finished{ false };
+
+    static Time successor(const Time& time) {
+        return Time(time.getR(), time.getC() + 1);
+    }
+
+    Partition& partitionOf(Simulator& simulator) {
+        for (auto& partition : partitions) {
+            if (partition->simulator.get() == &simulator) {
+                return *partition;
+            }
+        }
+
+        throw std::invalid_argument("simulator is not a partition of this engine");
+    }
+
+    // Schedules whatever has arrived and returns the time below which the
+    // process is safe to run. An idle process drains under idleMutex so it
+    // is never seen idle while holding a message.
+    Time receive(Partition& partition) {
+        Simulator& simulator = *partition.simulator;
+        Time safe(std::numeric_limits<double>::infinity(), 0);
+        std::vector<Channel::Delivery> deliveries;
+
+        std::unique_lock<std::mutex> lock(idleMutex, std::defer_lock);
+
+        if (partition.idle) {
+            lock.lock();
+        }
+
+        for (Channel* channel : simulator.boundaryInputs) {
+            deliveries.clear();
+            safe = std::min(safe, channel->receive(deliveries));
+
+            for (const Channel::Delivery& delivery : deliveries) {
+                simulator.queue.scheduleExternalEvent(delivery.message, channel->getPort(), delivery.time, channel->getDestination());
+            }
+
+            if (!deliveries.empty() && partition.idle) {
+                partition.idle = false;
+                idleCount--;
+            }
+        }
+
+        return safe;
+    }
+
+    // Nothing leaves the process before its next step, nor, for input not
+    // yet received, before the lookahead has passed.
+    void sendNullMessages(Partition& partition, const Time& safe) {
+        Simulator& simulator = *partition.simulator;
+        const double infinity = std::numeric_limits<double>::infinity();
+
+        Time next = simulator.queue.isEmpty() ? Time(infinity, 0) : successor(simulator.queue.nextEventTime());
+
+        for (Channel* channel : simulator.boundaryOutputs) {
+            Time bound(infinity, 0);
+
+            if (safe.getR() < infinity) {
+                bound = channel->getLookahead() > 0 ? Time(safe.getR() + channel->getLookahead(), 0) : successor(safe);
+            }
+
+            channel->advanceClock(std::min(next, bound));
+        }
+    }
+
+    void becomeIdle(Partition& partition) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+
+        if (!partition.idle) {
+            partition.idle = true;
+            idleCount++;
+        }
+
+        if (idleCount < partitions.size()) {
+            return;
+        }
+
+        for (const auto& channel : channels) {
+            if (!channel->isEmpty()) {
+                return;
+            }
+        }
+
+        finished = true;
+
+        for (auto& other : partitions) {
+            other->signal.raise();
+        }
+    }
+
+    void run(Partition& partition) {
+        Simulator& simulator = *partition.simulator;
+
+        while (!finished) {
+            Time safe = receive(partition);
+
+            while (!simulator.queue.isEmpty() && simulator.queue.nextEventTime() < safe) {
+                simulator.takeStep();
+            }
+
+            sendNullMessages(partition, safe);
+
+            if (simulator.queue.isEmpty()) {
+                becomeIdle(partition);
+            }
+
+            if (!finished) {
+                partition.signal.wait();
+            }
+        }
+    }
+
+public:
+    Simulator& addPartition(std::unique_ptr<EventQueueBackend> backend = std::unique_ptr<EventQueueBackend>(new BinaryHeapBackend())) {
+        partitions.emplace_back(new Partition());
+        partitions.back()->simulator.reset(new Simulator(std::move(backend)));
+
+        return *partitions.back()->simulator;
+    }
+
+    void addBoundaryCoupling(Simulator& from, SimulationModel* m1, Simulator& to, SimulationModel* m2) {
+        addBoundaryCoupling(from, m1, "out", to, m2, "in");
+    }
+
+    // Couples m1, a model of partition from, to m2 in partition to. The
+    // lookahead of the channel is m1's.
+    void addBoundaryCoupling(Simulator& from, SimulationModel* m1, const std::string& outputPort, Simulator& to, SimulationModel* m2, const std::string& inputPort) {
+        addBoundaryCoupling(from, m1, m1->getOutputPort(outputPort), to, m2, m2->getInputPort(inputPort));
+    }
+
+    void addBoundaryCoupling(Simulator& from, SimulationModel* m1, PortId outputPort, Simulator& to, SimulationModel* m2, PortId inputPort) {
+        Partition& destination = partitionOf(to);
+        partitionOf(from);
+
+        channels.emplace_back(new Channel(m2, inputPort, m1->lookahead()));
+        Channel* channel = channels.back().get();
+        channel->setReceiver(&destination.signal);
+
+        from.addBoundaryCoupling(m1, outputPort, channel);
+        to.addBoundaryInput(channel);
+    }
+
+    // Runs the thread of partition i on cores[i], with its events moved to
+    // that core's NUMA node; see Simulator::placePartitions().
+    void setCores(std::vector<int> cores) {
+        this->cores = std::move(cores);
+    }
+
+    std::string simulate() {
+        Time start(std::numeric_limits<double>::infinity(), 0);
+
+        for (auto& partition : partitions) {
+            Simulator& simulator = *partition->simulator;
+
+            if (!simulator.routesAreBuilt) {
+                simulator.buildRoutes();
+            }
+
+            simulator.scheduleEvents();
+            simulator.timedTrace = &partition->trace;
+            partition->trace.clear();
+            partition->idle = false;
+
+            if (!simulator.queue.isEmpty()) {
+                start = std::min(start, simulator.queue.nextEventTime());
+            }
+        }
+
+        // Nothing can arrive anywhere before the earliest event of all.
+        for (auto& channel : channels) {
+            channel->advanceClock(start);
+        }
+
+        idleCount = 0;
+        finished = partitions.empty();
+
+        std::vector<std::thread> threads;
+
+        for (std::size_t i = 0; i < partitions.size(); i++) {
+            threads.emplace_back([this, i] {
+                if (i < cores.size() && NumaTopology::pinCurrentThread(cores[i])) {
+                    partitions[i]->simulator->relocate();
+                }
+
+                run(*partitions[i]);
+            });
+        }
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        std::vector<std::pair<Time, std::string>> lines;
+
+        for (auto& partition : partitions) {
+            partition->simulator->timedTrace = nullptr;
+            lines.insert(lines.end(), partition->trace.begin(), partition->trace.end());
+        }
+
+        std::stable_sort(lines.begin(), lines.end(),
+            [](const std::pair<Time, std::string>& a, const std::pair<Time, std::string>& b) { return a.first < b.first; });
+
+        std::string result;
+
+        for (const auto& line : lines) {
+            result += line.second;
+        }
+
+        return result;
+    }
+};
+
+// Runs a model split into logical processes under Time Warp. Processes step
+// ahead without waiting for their neighbours, saving the state of each model
+// before it transitions. A message stamped earlier than a step already taken
+// rolls the process back: models are restored, what the undone steps sent
+// is cancelled with anti-messages, and the queue is rebuilt from the logged
+// inputs. Every so many steps, and whenever a process runs dry, all of them
+// meet to compute global virtual time (GVT), the earliest time anything can
+// still be rolled back to; history before it is committed and let go. The
+// run ends when GVT is infinite. Only models that save and restore their
+// state can be rolled back. As with ConservativeSimulator, simultaneous
+// messages from different processes may be ordered differently than in a
+// single simulator.
+class OptimisticSimulator {
+private:
+    // State of a model as it was before it transitioned in the step at
+    // time, along with the time of the internal event it had pending.
+    struct Snapshot {
+        Time step;
+        SimulationModel* model;
+        Time internalEvent;
+        std::size_t offset;
+    };
+
+    struct Partition {
+        std::unique_ptr<Simulator> simulator;
+        WakeSignal signal;
+
+        // Time of the latest step taken and not rolled back.
+        Time now = Time(-std::numeric_limits<double>::infinity(), 0);
+
+        std::vector<Snapshot> snapshots;
+        StateBuffer states;
+        std::vector<std::size_t> savedInStep;
+        std::size_t stepCount = 0;
+
+        std::vector<LoggedInput> inputs;
+        std::vector<std::pair<Time, std::string>> trace;
+        std::vector<std::pair<Time, std::string>> committed;
+
+        // Anti-messages that found no input to cancel, by channel and
+        // sequence; the positive is dropped when it does arrive.
+        std::vector<std::pair<Channel*, std::uint64_t>> annihilations;
+
+        std::size_t stepsSinceGvt = 0;
+        bool hasRequestedGvt = false;
+    };
+
+    std::vector<std::unique_ptr<Partition>> partitions;
+    std::vector<std::unique_ptr<Channel>> channels;
+    std::vector<int> cores;
+    std::size_t gvtInterval;
+
+    std::atomic<bool> gvtRequested{ false };
+    std::atomic<std::size_t> antiMessageCount{ 0 };
+    std::atomic<std::size_t> rollbackCount{ 0 };
+
+    std::mutex barrierMutex;
+    std::condition_variable barrierCondition;
+    std::size_t barrierArrivals = 0;
+    std::size_t barrierGeneration = 0;
+    Time gvtCandidate;
+
+    Partition& partitionOf(Simulator& simulator) {
+        for (auto& partition : partitions) {
+            if (partition->simulator.get() == &simulator) {
+                return *partition;
+            }
+        }
+
+        throw std::invalid_argument("simulator is not a partition of this engine");
+    }
+
+    // Waits for every process; the last to arrive runs completion first.
+    void synchronize(const std::function<void()>& completion = nullptr) {
+        std::unique_lock<std::mutex> lock(barrierMutex);
+        std::size_t generation = barrierGeneration;
+
+        if (++barrierArrivals == partitions.size()) {
+            barrierArrivals = 0;
+            barrierGeneration++;
+
+            if (completion) {
+                completion();
+            }
+
+            barrierCondition.notify_all();
+            return;
+        }
+
+        barrierCondition.wait(lock, [&] { return barrierGeneration != generation; });
+    }
+
+    void requestGvt() {
+        gvtRequested = true;
+
+        for (auto& partition : partitions) {
+            partition->signal.raise();
+        }
+    }
+
+    void step(Partition& partition) {
+        Simulator& simulator = *partition.simulator;
+        Time time = simulator.queue.nextEventTime();
+
+        EventSpan events = simulator.queue.getNextEvents();
+        partition.stepCount++;
+
+        for (const Event& event : events) {
+            SimulationModel* model = event.getModel();
+
+            if (model->id >= partition.savedInStep.size() || partition.savedInStep[model->id] == partition.stepCount) {
+                continue;
+            }
+
+            partition.savedInStep[model->id] = partition.stepCount;
+
+            Time internalEvent = event.getKind() == EventKind::External ? simulator.queue.internalEventTime(model) : time;
+            partition.snapshots.push_back({ time, model, internalEvent, partition.states.size() });
+            partition.states.write(model->randomStream.call);
+            model->saveState(partition.states);
+        }
+
+        simulator.process(events);
+        partition.now = time;
+    }
+
+    // Undoes every step at or after time and rebuilds the queue from the
+    // restored models and the inputs still pending.
+    void rollback(Partition& partition, const Time& time) {
+        Simulator& simulator = *partition.simulator;
+        std::vector<Time> internalEvents;
+
+        for (SimulationModel* model : simulator.models) {
+            internalEvents.push_back(simulator.queue.internalEventTime(model));
+        }
+
+        std::size_t kept = partition.snapshots.size();
+
+        while (kept > 0 && !(partition.snapshots[kept - 1].step < time)) {
+            const Snapshot& snapshot = partition.snapshots[--kept];
+
+            partition.states.seek(snapshot.offset);
+            partition.states.read(snapshot.model->randomStream.call);
+            snapshot.model->restoreState(partition.states);
+            internalEvents[snapshot.model->id] = snapshot.internalEvent;
+        }
+
+        if (kept < partition.snapshots.size()) {
+            partition.states.truncate(partition.snapshots[kept].offset);
+            partition.snapshots.resize(kept);
+            rollbackCount++;
+        }
+
+        partition.now = kept > 0 ? partition.snapshots[kept - 1].step : Time(-std::numeric_limits<double>::infinity(), 0);
+
+        // Inputs sent by the undone steps are stamped after time.
+        std::vector<LoggedInput>& inputs = partition.inputs;
+        inputs.erase(std::remove_if(inputs.begin(), inputs.end(),
+            [&](const LoggedInput& input) { return input.isLocal && time < input.time; }), inputs.end());
+
+        for (Channel* channel : simulator.boundaryOutputs) {
+            antiMessageCount += channel->retract(time);
+        }
+
+        while (!partition.trace.empty() && !(partition.trace.back().first < time)) {
+            partition.trace.pop_back();
+        }
+
+        simulator.queue.clear();
+
+        for (std::size_t i = 0; i < simulator.models.size(); i++) {
+            if (internalEvents[i].getR() < std::numeric_limits<double>::infinity()) {
+                simulator.queue.scheduleInternalEvent(internalEvents[i], simulator.models[i]);
+            }
+        }
+
+        for (const LoggedInput& input : inputs) {
+            if (partition.now < input.time) {
+                simulator.queue.scheduleExternalEvent(input.message, input.port, input.time, input.destination);
+            }
+        }
+    }
+
+    void receive(Partition& partition) {
+        Simulator& simulator = *partition.simulator;
+        std::vector<Channel::Delivery> deliveries;
+
+        for (Channel* channel : simulator.boundaryInputs) {
+            deliveries.clear();
+            channel->receive(deliveries);
+
+            for (Channel::Delivery& delivery : deliveries) {
+                if (delivery.isAnti) {
+                    std::vector<LoggedInput>& inputs = partition.inputs;
+                    auto cancelled = std::find_if(inputs.begin(), inputs.end(), [&](const LoggedInput& input) {
+                        return input.channel == channel && input.sequence == delivery.sequence;
+                    });
+
+                    if (cancelled == inputs.end()) {
+                        partition.annihilations.emplace_back(channel, delivery.sequence);
+                        continue;
+                    }
+
+                    Time time = cancelled->time;
+                    inputs.erase(cancelled);
+                    rollback(partition, time);
+                    continue;
+                }
+
+                auto annihilated = std::find(partition.annihilations.begin(), partition.annihilations.end(), std::make_pair(channel, delivery.sequence));
+
+                if (annihilated != partition.annihilations.end()) {
+                    partition.annihilations.erase(annihilated);
+                    continue;
+                }
+
+                if (!(partition.now < delivery.time)) {
+                    rollback(partition, delivery.time);
+                }
+
+                partition.inputs.push_back({ delivery.time, channel->getDestination(), channel->getPort(), delivery.message, channel, delivery.sequence, false });
+                simulator.queue.scheduleExternalEvent(delivery.message, channel->getPort(), delivery.time, channel->getDestination());
+            }
+        }
+    }
+
+    // History before gvt can no longer be rolled back to.
+    void collectFossils(Partition& partition, const Time& gvt) {
+        std::vector<Snapshot>& snapshots = partition.snapshots;
+        std::size_t first = 0;
+
+        while (first < snapshots.size() && snapshots[first].step < gvt) {
+            first++;
+        }
+
+        if (first > 0) {
+            std::size_t discarded = first < snapshots.size() ? snapshots[first].offset : partition.states.size();
+
+            partition.states.discardFront(discarded);
+            snapshots.erase(snapshots.begin(), snapshots.begin() + first);
+
+            for (Snapshot& snapshot : snapshots) {
+                snapshot.offset -= discarded;
+            }
+        }
+
+        std::vector<LoggedInput>& inputs = partition.inputs;
+        inputs.erase(std::remove_if(inputs.begin(), inputs.end(),
+            [&](const LoggedInput& input) { return input.time < gvt; }), inputs.end());
+
+        for (Channel* channel : partition.simulator->boundaryOutputs) {
+            channel->forgetBefore(gvt);
+        }
+
+        std::size_t committed = 0;
+
+        while (committed < partition.trace.size() && partition.trace[committed].first < gvt) {
+            committed++;
+        }
+
+        partition.committed.insert(partition.committed.end(), partition.trace.begin(), partition.trace.begin() + committed);
+        partition.trace.erase(partition.trace.begin(), partition.trace.begin() + committed);
+    }
+
+    // Stops every process, delivers whatever is in flight until rollbacks
+    // send nothing more, and takes GVT as the earliest pending event left.
+    // Returns false once the run is over.
+    bool advanceGvt(Partition& partition) {
+        const double infinity = std::numeric_limits<double>::infinity();
+
+        synchronize([this, infinity] {
+            gvtRequested = false;
+            gvtCandidate = Time(infinity, 0);
+        });
+
+        std::size_t sent = antiMessageCount;
+        synchronize();
+
+        while (true) {
+            receive(partition);
+            synchronize();
+
+            std::size_t nowSent = antiMessageCount;
+            synchronize();
+
+            if (nowSent == sent) {
+                break;
+            }
+
+            sent = nowSent;
+        }
+
+        Simulator& simulator = *partition.simulator;
+
+        {
+            std::lock_guard<std::mutex> lock(barrierMutex);
+
+            if (!simulator.queue.isEmpty()) {
+                gvtCandidate = std::min(gvtCandidate, simulator.queue.nextEventTime());
+            }
+        }
+
+        synchronize();
+
+        Time gvt;
+
+        {
+            std::lock_guard<std::mutex> lock(barrierMutex);
+            gvt = gvtCandidate;
+        }
+
+        collectFossils(partition, gvt);
+        partition.stepsSinceGvt = 0;
+
+        return gvt.getR() < infinity;
+    }
+
+    void run(Partition& partition) {
+        Simulator& simulator = *partition.simulator;
+
+        while (true) {
+            if (gvtRequested) {
+                if (!advanceGvt(partition)) {
+                    return;
+                }
+
+                continue;
+            }
+
+            receive(partition);
+
+            if (!simulator.queue.isEmpty()) {
+                step(partition);
+                partition.hasRequestedGvt = false;
+
+                if (++partition.stepsSinceGvt >= gvtInterval) {
+                    requestGvt();
+                }
+
+                continue;
+            }
+
+            if (!partition.hasRequestedGvt) {
+                partition.hasRequestedGvt = true;
+                requestGvt();
+                continue;
+            }
+
+            partition.signal.wait();
+        }
+    }
+
+public:
+    // Processes meet to advance GVT at least every gvtInterval steps, which
+    // bounds how much history each keeps.
+    OptimisticSimulator(std::size_t gvtInterval = 1024) : gvtInterval(std::max<std::size_t>(1, gvtInterval)) {}
+
+    Simulator& addPartition(std::unique_ptr<EventQueueBackend> backend = std::unique_ptr<EventQueueBackend>(new BinaryHeapBackend())) {
+        partitions.emplace_back(new Partition());
+        partitions.back()->simulator.reset(new Simulator(std::move(backend)));
+
+        return *partitions.back()->simulator;
+    }
+
+    void addBoundaryCoupling(Simulator& from, SimulationModel* m1, Simulator& to, SimulationModel* m2) {
+        addBoundaryCoupling(from, m1, "out", to, m2, "in");
+    }
+
+    void addBoundaryCoupling(Simulator& from, SimulationModel* m1, const std::string& outputPort, Simulator& to, SimulationModel* m2, const std::string& inputPort) {
+        addBoundaryCoupling(from, m1, m1->getOutputPort(outputPort), to, m2, m2->getInputPort(inputPort));
+    }
+
+    void addBoundaryCoupling(Simulator& from, SimulationModel* m1, PortId outputPort, Simulator& to, SimulationModel* m2, PortId inputPort) {
+        Partition& destination = partitionOf(to);
+        partitionOf(from);
+
+        channels.emplace_back(new Channel(m2, inputPort, m1->lookahead()));
+        Channel* channel = channels.back().get();
+        channel->setReceiver(&destination.signal);
+        channel->setJournaled(true);
+
+        from.addBoundaryCoupling(m1, outputPort, channel);
+        to.addBoundaryInput(channel);
+    }
+
+    // As ConservativeSimulator::setCores().
+    void setCores(std::vector<int> cores) {
+        this->cores = std::move(cores);
+    }
+
+    std::size_t getRollbackCount() const {
+        return rollbackCount;
+    }
+
+    std::string simulate() {
+        for (auto& partition : partitions) {
+            Simulator& simulator = *partition->simulator;
+
+            if (!simulator.routesAreBuilt) {
+                simulator.buildRoutes();
+            }
+
+            partition->inputs.clear();
+            partition->annihilations.clear();
+            partition->trace.clear();
+            partition->committed.clear();
+            partition->savedInStep.assign(simulator.models.size(), 0);
+
+            simulator.timedTrace = &partition->trace;
+            simulator.inputLog = &partition->inputs;
+            simulator.scheduleEvents();
+        }
+
+        gvtRequested = false;
+        rollbackCount = 0;
+
+        std::vector<std::thread> threads;
+
+        for (std::size_t i = 0; i < partitions.size(); i++) {
+            threads.emplace_back([this, i] {
+                if (i < cores.size() && NumaTopology::pinCurrentThread(cores[i])) {
+                    partitions[i]->simulator->relocate();
+                }
+
+                run(*partitions[i]);
+            });
+        }
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        std::vector<std::pair<Time, std::string>> lines;
+
+        for (auto& partition : partitions) {
+            partition->simulator->timedTrace = nullptr;
+            partition->simulator->inputLog = nullptr;
+            lines.insert(lines.end(), partition->committed.begin(), partition->committed.end());
+        }
+
+        std::stable_sort(lines.begin(), lines.end(),
+            [](const std::pair<Time, std::string>& a, const std::pair<Time, std::string>& b) { return a.first < b.first; });
+
+        std::string result;
+
+        for (const auto& line : lines) {
+            result += line.second;
+        }
+
+        return result;
+    }
+};
+
+// One run of an ensemble: a simulator together with the models and sources
+// it runs on, which the replication owns, and a random stream of its own.
+class Replication {
+private:
+    std::size_t index;
+    std::mt19937_64 random;
+    std::uint64_t modelSeed;
+    Simulator simulator;
+    std::vector<std::unique_ptr<SimulationModel>> models;
+    std::vector<std::unique_ptr<InputSource>> sources;
+
+public:
+    // The stream depends only on the seed and the index, so a replication
+    // comes out the same however the ensemble is scheduled.
+    Replication(std::size_t index, std::uint64_t seed) : index(index) {
+        std::seed_seq sequence = { static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32),
+            static_cast<std::uint32_t>(index), static_cast<std::uint32_t>(static_cast<std::uint64_t>(index) >> 32) };
+        random.seed(sequence);
+
+        std::uint32_t words[2];
+        sequence.generate(words, words + 2);
+        modelSeed = static_cast<std::uint64_t>(words[1]) << 32 | words[0];
+    }
+
+    Replication(const Replication&) = delete;
+    Replication& operator=(const Replication&) = delete;
+
+    // Creates a model owned by the replication and adds it to the simulator.
+    // Its random stream is seeded from the replication's, so the same model
+    // draws different numbers in every replication.
+    template <typename Model, typename... Args>
+    Model* addModel(Args&&... args) {
+        Model* model = new Model(std::forward<Args>(args)...);
+        model->setRandomStream(modelSeed, static_cast<std::uint32_t>(models.size()));
+        models.emplace_back(model);
+        simulator.addModel(model);
+
+        return model;
+    }
+
+    template <typename Source, typename... Args>
+    Source* addInputSource(Args&&... args) {
+        Source* source = new Source(std::forward<Args>(args)...);
+        sources.emplace_back(source);
+        simulator.addInputSource(source);
+
+        return source;
+    }
+
+    std::size_t getIndex() const {
+        return index;
+    }
+
+    std::mt19937_64& getRandom() {
+        return random;
+    }
+
+    Simulator& getSimulator() {
+        return simulator;
+    }
+};
+
+// Runs independent replications of a model across cores, all in one
+// process. The factory sets up each replication, e.g. drawing its
+// parameters and input schedule from the replication's random stream; each
+// is built, run and torn down on a worker thread. Results come back in
+// replication order, whatever order they finished in.
+class Ensemble {
+private:
+    std::function<void(Replication&)> factory;
+    std::uint64_t seed;
+    ThreadPool threadPool;
+
+public:
+    Ensemble(std::function<void(Replication&)> factory, std::uint64_t seed = 0, std::size_t threads = std::thread::hardware_concurrency())
+        : factory(std::move(factory)), seed(seed), threadPool(std::max<std::size_t>(1, threads)) {}
+
+    // Runs each replication to the end and hands it to collect for its
+    // result.
+    template <typename Result>
+    std::vector<Result> run(std::size_t count, const std::function<Result(Replication&, const std::string&)>& collect) {
+        std::vector<Result> results(count);
+
+        threadPool.parallelFor(count, 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                Replication replication(i, seed);
+                factory(replication);
+
+                std::string output = replication.getSimulator().simulate();
+                results[i] = collect(replication, output);
+            }
+        });
+
+        return results;
+    }
+
+    // The trace of each replication.
+    std::vector<std::string> run(std::size_t count) {
+        return run<std::string>(count, [](Replication&, const std::string& output) { return output; });
+    }
+};
+
+// Declarations of a coupled model fixed at compile time, for
+// StaticSimulator. Models are named by their position in Models<...> and
+// ports by number, so Connect<0, 1> couples output port 0 of the first
+// model to input port 0 of the second.
+template <typename... Model>
+struct Models {};
+
+template <std::size_t From, std::size_t To, PortId FromPort = 0, PortId ToPort = 0>
+struct Connect {};
+
+template <std::size_t To, PortId ToPort = 0>
+struct Input {};
+
+template <std::size_t From, PortId FromPort = 0>
+struct Output {};
+
+template <typename... Coupling>
+struct Couplings {};
+
+// Whether lambda(MessageBag&) is visible in Model, or hidden by a
+// single-output lambda() it declares.
+template <typename Model, typename = void>
+struct HasBagLambda : std::false_type {};
+
+template <typename Model>
+struct HasBagLambda<Model, decltype(std::declval<Model&>().lambda(std::declval<MessageBag&>()), void())> : std::true_type {};
+
+template <typename ModelList, typename CouplingList>
+class StaticSimulator;
+
+// Runs a coupled model whose models and couplings are types, for fixed
+// topologies where Simulator's queue and routing tables cost more than the
+// models themselves. The models live by value in the simulator and are
+// called non-virtually; every step scans them in order, and outputs are
+// routed through couplings resolved at compile time. Results match a
+// Simulator's built from the same models, except that simultaneous events
+// run in model order rather than the order they were scheduled in.
+template <typename... Model, typename... Coupling>
+class StaticSimulator<Models<Model...>, Couplings<Coupling...>> {
+private:
+    static_assert(sizeof...(Model) > 0, "a coupled model needs at least one model");
+    static_assert(std::conjunction<std::is_base_of<SimulationModel, Model>...>::value, "models derive from SimulationModel");
+
+    static const std::size_t COUNT = sizeof...(Model);
+
+    typedef std::make_index_sequence<COUNT> Indices;
+
+    template <std::size_t I>
+    using ModelAt = typename std::tuple_element<I, std::tuple<Model...>>::type;
+
+    std::tuple<Model...> models;
+
+    // Each model's pending internal event. Outputs always arrive one
+    // micro-step after the step that emitted them, so all the pending
+    // inputs of a step are gathered in arrivals while the next step's are
+    // collected in nextArrivals.
+    Time internalEvents[COUNT];
+    MessageBag arrivals[COUNT];
+    MessageBag nextArrivals[COUNT];
+    MessageBag outputs;
+    bool hasArrivals = false;
+
+    // Quantized as they are added, so they line up with the model times.
+    // nextInput is the first not yet delivered once the run has started.
+    std::multimap<Time, Message> inputs;
+    std::multimap<Time, Message>::const_iterator nextInput;
+    std::stringstream trace;
+    std::uint64_t eventCount = 0;
+    bool isStarted = false;
+
+    Time now;
+
+    template <std::size_t I, std::size_t From, std::size_t To, PortId FromPort, PortId ToPort>
+    void routeAlong(const Message& output, double, Connect<From, To, FromPort, ToPort>) {
+        static_assert(From < COUNT && To < COUNT, "coupling of a model that does not exist");
+
+        if constexpr (From == I) {
+            if (output.getPort() == FromPort) {
+                nextArrivals[To].push_back(output);
+                nextArrivals[To].back().setPort(ToPort);
+                hasArrivals = true;
+            }
+        }
+    }
+
+    template <std::size_t I, std::size_t From, PortId FromPort>
+    void routeAlong(const Message& output, double r, Output<From, FromPort>) {
+        static_assert(From < COUNT, "output of a model that does not exist");
+
+        if constexpr (From == I) {
+            if (output.getPort() == FromPort) {
+                trace << r << " - " << output << "\n";
+            }
+        }
+    }
+
+    template <std::size_t I, std::size_t To, PortId ToPort>
+    void routeAlong(const Message&, double, Input<To, ToPort>) {}
+
+    template <std::size_t To, PortId ToPort>
+    void routeInput(const Message& input, Input<To, ToPort>) {
+        static_assert(To < COUNT, "input to a model that does not exist");
+
+        arrivals[To].push_back(input);
+        arrivals[To].back().setPort(ToPort);
+    }
+
+    template <typename Other>
+    void routeInput(const Message&, Other) {}
+
+    template <std::size_t I>
+    void computeOutputs(double r) {
+        if (!(internalEvents[I] == now)) {
+            return;
+        }
+
+        ModelAt<I>& model = std::get<I>(models);
+        static_cast<SimulationModel&>(model).randomStream.beginCall();
+
+        if constexpr (HasBagLambda<ModelAt<I>>::value) {
+            outputs.clear();
+            model.ModelAt<I>::lambda(outputs);
+
+            for (const Message& output : outputs) {
+                (routeAlong<I>(output, r, Coupling()), ...);
+            }
+        }
+        else {
+            Message output = model.ModelAt<I>::lambda();
+
+            if (!output.isEmpty()) {
+                (routeAlong<I>(output, r, Coupling()), ...);
+            }
+        }
+    }
+
+    template <std::size_t I>
+    void applyTransitions(double r) {
+        MessageBag& arrived = arrivals[I];
+        bool isImminent = internalEvents[I] == now;
+
+        if (!isImminent && arrived.empty()) {
+            return;
+        }
+
+        ModelAt<I>& model = std::get<I>(models);
+        std::size_t first = 0;
+
+        RandomStream& random = static_cast<SimulationModel&>(model).randomStream;
+
+        if (isImminent && arrived.empty()) {
+            random.beginCall();
+            model.ModelAt<I>::deltaInt(r);
+            eventCount++;
+        }
+        else if (isImminent) {
+            random.beginCall();
+            model.ModelAt<I>::deltaCon(arrived[0], r);
+            first = 1;
+        }
+
+        for (std::size_t i = first; i < arrived.size(); i++) {
+            random.beginCall();
+            model.ModelAt<I>::deltaExt(arrived[i], r);
+        }
+
+        eventCount += arrived.size();
+        arrived.clear();
+
+        double nextInternalEvent = model.ModelAt<I>::getNextInternalEvent();
+        internalEvents[I] = Time(nextInternalEvent, 0);
+
+        if (internalEvents[I].isSimultaneousWith(now)) {
+            internalEvents[I] = Time(nextInternalEvent, now.getC() + 1);
+        }
+    }
+
+    Time nextEventTime() const {
+        if (hasArrivals) {
+            return Time(now.getR(), now.getC() + 1);
+        }
+
+        Time next = nextInput == inputs.end() ? Time(std::numeric_limits<double>::infinity(), 0) : nextInput->first;
+
+        for (const Time& time : internalEvents) {
+            if (time < next) {
+                next = time;
+            }
+        }
+
+        return next;
+    }
+
+    // Model I gets stream I, as it would as the Ith model of a Simulator.
+    template <std::size_t I>
+    void setRandomStream() {
+        RandomStream& random = static_cast<SimulationModel&>(std::get<I>(models)).randomStream;
+
+        if (!random.isSet) {
+            random.setStream(0, static_cast<std::uint32_t>(I));
+        }
+    }
+
+    template <std::size_t... I>
+    void setRandomStreams(std::index_sequence<I...>) {
+        (setRandomStream<I>(), ...);
+    }
+
+    template <std::size_t... I>
+    void scheduleInitialEvents(std::index_sequence<I...>) {
+        ((internalEvents[I] = Time(std::get<I>(models).ModelAt<I>::getNextInternalEvent(), 0)), ...);
+    }
+
+    void initialize() {
+        for (Time& time : internalEvents) {
+            time = Time(std::numeric_limits<double>::infinity(), 0);
+        }
+
+        setRandomStreams(Indices());
+    }
+
+    template <std::size_t... I>
+    void step(std::index_sequence<I...>) {
+        double r = now.getR();
+
+        if (hasArrivals) {
+            for (std::size_t i = 0; i < COUNT; i++) {
+                arrivals[i].swap(nextArrivals[i]);
+            }
+
+            hasArrivals = false;
+        }
+
+        for (; nextInput != inputs.end() && nextInput->first.isSimultaneousWith(now); nextInput++) {
+            (routeInput(nextInput->second, Coupling()), ...);
+        }
+
+        (computeOutputs<I>(r), ...);
+        (applyTransitions<I>(r), ...);
+    }
+
+public:
+    StaticSimulator() : now(-std::numeric_limits<double>::infinity(), 0) {
+        initialize();
+    }
+
+    // Copies of the given models, for models without default constructors.
+    explicit StaticSimulator(const Model&... models) : models(models...), now(-std::numeric_limits<double>::infinity(), 0) {
+        initialize();
+    }
+
+    template <std::size_t I>
+    ModelAt<I>& get() {
+        return std::get<I>(models);
+    }
+
+    // Inputs at the same time are all delivered, in the order added. Once
+    // the run has started, none can come before the events already run.
+    void addInput(const Message& input, double r) {
+        if (isStarted && r < now.getR()) {
+            throw std::runtime_error("inputs must come in time order");
+        }
+
+        std::multimap<Time, Message>::const_iterator added = inputs.emplace(Time(r, 0), input);
+
+        if (isStarted && (nextInput == inputs.end() || added->first < nextInput->first)) {
+            nextInput = added;
+        }
+    }
+
+    // Events run over the simulator's lifetime.
+    std::uint64_t getEventCount() const {
+        return eventCount;
+    }
+
+    // Runs until no events are left. A later call carries on from there, as
+    // Simulator::simulate() does, with any inputs added since.
+    std::string simulate() {
+        if (!isStarted) {
+            nextInput = inputs.begin();
+            scheduleInitialEvents(Indices());
+            isStarted = true;
+        }
+
+        while (true) {
+            Time next = nextEventTime();
+
+            if (next.getR() == std::numeric_limits<double>::infinity()) {
+                break;
+            }
+
+            now = next;
+            step(Indices());
+        }
+
+        std::string result = trace.str();
+        trace.str("");
+
+        return result;
+    }
+};
@@ -0,0 +1,813 @@
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstddef>
+
+#include "../MatthewDBrown-CSC454-Homework5-CPP/ExampleModels.h"
+
+//---------------------------------------------------
+// TESTS
+//---------------------------------------------------
+
+// A test returns normally or throws Failure saying what went wrong.
+class Failure : public std::runtime_error {
+public:
+    explicit Failure(const std::string& what) : std::runtime_error(what) {}
+};
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        throw Failure(what);
+    }
+}
+
+static void checkThrows(const std::function<void()>& run, const std::string& what) {
+    try {
+        run();
+    }
+    catch (const std::runtime_error&) {
+        return;
+    }
+
+    throw Failure(what);
+}
+
+static std::vector<char> readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& path, const std::vector<char>& bytes) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+static void checkTrace(const std::string& expected, const std::string& actual) {
+    if (expected.empty() || actual != expected) {
+        throw Failure("trace differs\nexpected:\n" + expected + "actual:\n" + actual);
+    }
+}
+
+//---------------------------------------------------
+// EXECUTION MODES
+//---------------------------------------------------
+
+// Every execution mode runs the example's press and drill and has to come
+// out with the trace of a plain Simulator::simulate().
+
+// The inputs at 3.5 and 5.5 arrive as the press finishes a part, so the run
+// takes confluent events as well as internal and external ones.
+static void addInputs(Simulator& sim) {
+    sim.addInput(12, 1.5);
+    sim.addInput(2, 2.7);
+    sim.addInput(1, 3.5);
+    sim.addInput(1, 5.5);
+    sim.addInput(1, 5.5);
+}
+
+struct PressDrill {
+    Simulator sim;
+    Press press;
+    Drill drill;
+
+    PressDrill(std::unique_ptr<EventQueueBackend> backend = std::unique_ptr<EventQueueBackend>(new BinaryHeapBackend())) : sim(std::move(backend)) {
+        sim.addModel(&press);
+        sim.addModel(&drill);
+        sim.addCoupling(&press, &drill);
+        sim.routeInputTo(&press);
+        sim.takeOutputFrom(&drill);
+        addInputs(sim);
+    }
+};
+
+static std::string reference() {
+    PressDrill model;
+
+    return model.sim.simulate();
+}
+
+static std::string runBackend(EventQueueBackend* backend) {
+    PressDrill model{ std::unique_ptr<EventQueueBackend>(backend) };
+
+    return model.sim.simulate();
+}
+
+static std::string runParallel() {
+    PressDrill model;
+    model.sim.setParallelism(2, 1);
+
+    return model.sim.simulate();
+}
+
+static std::string runStatic() {
+    StaticSimulator<Models<Press, Drill>, Couplings<Input<0>, Connect<0, 1>, Output<1>>> composed;
+    composed.addInput(12, 1.5);
+    composed.addInput(2, 2.7);
+    composed.addInput(1, 3.5);
+    composed.addInput(1, 5.5);
+    composed.addInput(1, 5.5);
+
+    return composed.simulate();
+}
+
+template <typename Engine>
+static std::string runDistributed() {
+    PressDrill model;
+    Engine engine;
+    model.sim.distributeTo(engine, { 0, 1 });
+
+    return engine.simulate();
+}
+
+static std::string runIncremental() {
+    PressDrill model;
+    std::string output;
+
+    while (model.sim.step()) {
+        output += model.sim.takeOutputs();
+    }
+
+    return output + model.sim.takeOutputs();
+}
+
+static std::string runCheckpointed() {
+    const std::string path = "tests-checkpoint.bin";
+    PressDrill first;
+
+    first.sim.runUntil(Time(20.0, 0));
+    std::string output = first.sim.takeOutputs();
+    first.sim.saveCheckpoint(path);
+
+    PressDrill second;
+    second.sim.restoreCheckpoint(path);
+    std::remove(path.c_str());
+
+    return output + second.sim.simulate();
+}
+
+// The trace is rebuilt from the output records read back from the file.
+static std::string runTraced() {
+    const std::string path = "tests-trace.bin";
+
+    {
+        PressDrill model;
+        BinaryTraceWriter writer(path);
+        model.sim.setTraceWriter(&writer);
+        model.sim.simulate();
+        writer.close();
+    }
+
+    std::stringstream output;
+
+    {
+        BinaryTraceReader reader(path);
+
+        for (const TraceRecord& record : reader) {
+            if (record.kind == TraceKind::Output) {
+                output << record.r << " - " << reader.getPayload(record) << "\n";
+            }
+        }
+    }
+
+    std::remove(path.c_str());
+
+    return output.str();
+}
+
+#ifdef DEVS_COROUTINES
+// The inputs sent by a process coupled to the press instead.
+class InputProcess : public ProcessModel {
+protected:
+    Process run() override {
+        co_await hold(1.5);
+        send(12);
+        co_await hold(1.2);
+        send(2);
+        co_await hold(0.8);
+        send(1);
+        co_await hold(2.0);
+        send(1);
+        send(1);
+    }
+};
+
+static std::string runProcess() {
+    Simulator sim;
+    InputProcess inputs;
+    Press press;
+    Drill drill;
+
+    sim.addModel(&inputs);
+    sim.addModel(&press);
+    sim.addModel(&drill);
+    sim.addCoupling(&inputs, &press);
+    sim.addCoupling(&press, &drill);
+    sim.takeOutputFrom(&drill);
+
+    return sim.simulate();
+}
+#endif
+
+//---------------------------------------------------
+// TIME
+//---------------------------------------------------
+
+// Fixed-point times that round to the same tick are simultaneous, however
+// they were summed, and times beyond the ticks saturate to infinity.
+static void testFixedPointGrouping() {
+    typedef BasicTime<FixedPoint<1000>> FixedTime;
+    typedef BasicTime<FloatingPoint> FloatingTime;
+
+    check(!FloatingTime(0.1 + 0.2).isSimultaneousWith(FloatingTime(0.3)), "floating-point times were rounded");
+    check(FixedTime(0.1 + 0.2) == FixedTime(0.3), "0.1 + 0.2 and 0.3 fell on different ticks");
+    check(FixedTime(0.3004).isSimultaneousWith(FixedTime(0.3)), "times within half a tick were not grouped");
+    check(FixedTime(0.3) < FixedTime(0.3006), "times a tick apart were grouped");
+    check(FixedTime(0.3, 0) < FixedTime(0.3, 1) && FixedTime(0.3, 1) < FixedTime(0.301, 0), "micro-steps are out of order");
+
+    const double infinity = std::numeric_limits<double>::infinity();
+    check(FixedTime(1e300).getR() == infinity && FixedTime(1e300) == FixedTime(infinity), "a time beyond the ticks did not saturate");
+    check(FixedTime(-1e300).getR() == -infinity, "a time below the ticks did not saturate");
+    check(FixedTime(-1e300) < FixedTime(0.0) && FixedTime(1e12) < FixedTime(infinity), "saturated times are out of order");
+}
+
+// Inputs too far out for the calendar's days, or infinitely far, come out
+// in the same order as from a heap.
+static std::string runFarInputs(EventQueueBackend* backend) {
+    PressDrill model{ std::unique_ptr<EventQueueBackend>(backend) };
+    model.sim.addInput(1, 1e300);
+    model.sim.addInput(3, 1e20);
+    model.sim.addInput(1, std::numeric_limits<double>::infinity());
+
+    return model.sim.simulate();
+}
+
+//---------------------------------------------------
+// RANDOM STREAMS
+//---------------------------------------------------
+
+// Three random machines in a line, the first and last in one logical
+// process and the middle one in another, so the first process keeps
+// rolling its draws back as the middle machine's parts reach the last.
+struct RandomLine {
+    Simulator sim;
+    RandomMachine first{ 0.5, 1.0 };
+    RandomMachine middle{ 0.5, 0.5 };
+    RandomMachine last{ 0.5, 1.0 };
+
+    RandomLine() {
+        sim.addModel(&first);
+        sim.addModel(&middle);
+        sim.addModel(&last);
+        sim.addCoupling(&first, &middle);
+        sim.addCoupling(&middle, &last);
+        sim.routeInputTo(&first);
+        sim.takeOutputFrom(&last);
+
+        for (int i = 0; i < 40; i++) {
+            sim.addInput(1 + i % 3, 0.7 * i);
+        }
+    }
+};
+
+// Every model draws the same numbers however the run is split up, and
+// whatever it rolls back. Runs are repeated since how often the optimistic
+// engine rolls back depends on the threads' timing.
+static void testRandomUnderRollback() {
+    std::string expected = RandomLine().sim.simulate();
+
+    RandomLine conservative;
+    ConservativeSimulator conservativeEngine;
+    conservative.sim.distributeTo(conservativeEngine, { 0, 1, 0 });
+    checkTrace(expected, conservativeEngine.simulate());
+
+    for (int run = 0; run < 5; run++) {
+        RandomLine optimistic;
+        OptimisticSimulator optimisticEngine;
+        optimistic.sim.distributeTo(optimisticEngine, { 0, 1, 0 });
+        checkTrace(expected, optimisticEngine.simulate());
+    }
+}
+
+//---------------------------------------------------
+// INPUT SOURCES
+//---------------------------------------------------
+
+// The example's inputs, pulled from a generator as the run goes.
+static void testSourceMatchesInputs() {
+    const std::vector<std::pair<double, int>> schedule = { { 1.5, 12 }, { 2.7, 2 }, { 3.5, 1 }, { 5.5, 1 }, { 5.5, 1 } };
+    std::size_t next = 0;
+
+    GeneratorSource source([&](double& r, Message& input) {
+        if (next == schedule.size()) {
+            return false;
+        }
+
+        r = schedule[next].first;
+        input = schedule[next].second;
+        next++;
+
+        return true;
+    });
+
+    Simulator sim;
+    Press press;
+    Drill drill;
+    sim.addModel(&press);
+    sim.addModel(&drill);
+    sim.addCoupling(&press, &drill);
+    sim.routeInputTo(&press);
+    sim.takeOutputFrom(&drill);
+    sim.addInputSource(&source);
+
+    checkTrace(reference(), sim.simulate());
+}
+
+// An unbounded source whose inputs go nowhere must not stall the run.
+static void testUnroutedSource() {
+    double time = 0.0;
+    GeneratorSource source([&](double& r, Message& input) {
+        r = time += 1.0;
+        input = 1;
+
+        return true;
+    });
+
+    Simulator sim;
+    Press press;
+    sim.addModel(&press);
+    sim.takeOutputFrom(&press);
+    sim.addInputSource(&source);
+
+    check(!sim.runUntil(Time(10.0, 0)), "runUntil() found events to run");
+    check(!sim.step(), "step() found an event to run");
+    check(sim.simulate().empty(), "unrouted inputs reached the press");
+}
+
+//---------------------------------------------------
+// OUTPUT SINKS
+//---------------------------------------------------
+
+// Each sink takes the outputs in the format of the trace, which simulate()
+// then leaves empty.
+static void testSinks() {
+    std::stringstream called;
+    CallbackSink callback([&](double r, const Message& output) { called << r << " - " << output << "\n"; });
+
+    PressDrill first;
+    first.sim.setOutputSink(&callback);
+    check(first.sim.simulate().empty(), "outputs went to the sink and the trace");
+    checkTrace(reference(), called.str());
+
+    const std::string path = "tests-sink.txt";
+    FileSink file(path, 2);
+
+    PressDrill second;
+    second.sim.setOutputSink(&file);
+    second.sim.simulate();
+    file.close();
+
+    std::vector<char> written = readFile(path);
+    std::remove(path.c_str());
+    checkTrace(reference(), std::string(written.begin(), written.end()));
+
+    // A ring smaller than the run, so the simulation waits on the reader.
+    RingBufferSink ring(2);
+    std::stringstream read;
+
+    std::thread reader([&] {
+        double r;
+        Message output;
+
+        while (ring.read(r, output)) {
+            read << r << " - " << output << "\n";
+        }
+    });
+
+    PressDrill third;
+    third.sim.setOutputSink(&ring);
+    third.sim.simulate();
+    ring.close();
+    reader.join();
+    checkTrace(reference(), read.str());
+}
+
+#ifdef __linux__
+// Writes that fail on the writer thread are thrown from the run's flush.
+static void testFullDiskSink() {
+    FileSink file("/dev/full", 1);
+
+    PressDrill model;
+    model.sim.setOutputSink(&file);
+
+    checkThrows([&] { model.sim.simulate(); }, "outputs written to a full disk flushed cleanly");
+    checkThrows([&] { file.close(); }, "a sink that lost outputs closed cleanly");
+}
+#endif
+
+//---------------------------------------------------
+// BINARY TRACES
+//---------------------------------------------------
+
+// Damaged traces are refused, or their damaged records are, rather than
+// read out of bounds.
+static void testCorruptTrace() {
+    const std::string path = "tests-corrupt.bin";
+
+    {
+        PressDrill model;
+        BinaryTraceWriter writer(path);
+        model.sim.setTraceWriter(&writer);
+        model.sim.simulate();
+        writer.close();
+    }
+
+    std::vector<char> trace = readFile(path);
+    TraceHeader header;
+    std::memcpy(&header, trace.data(), sizeof(header));
+
+    std::vector<char> truncated(trace.begin(), trace.begin() + trace.size() / 2);
+    writeFile(path, truncated);
+    checkThrows([&] { BinaryTraceReader reader(path); }, "a truncated trace was read");
+
+    std::vector<char> oversized = trace;
+    std::uint64_t textSize = trace.size();
+    std::memcpy(oversized.data() + offsetof(TraceHeader, textSize), &textSize, sizeof(textSize));
+    writeFile(path, oversized);
+    checkThrows([&] { BinaryTraceReader reader(path); }, "a text section overlapping the index was read");
+
+    std::vector<char> misplaced = trace;
+    std::size_t text = 0;
+
+    for (std::size_t i = 0; i < header.recordCount; i++) {
+        TraceRecord record;
+        std::memcpy(&record, trace.data() + header.recordsOffset + i * sizeof(TraceRecord), sizeof(record));
+
+        if (record.type == Message::Type::Text) {
+            std::uint64_t offset = header.textSize;
+            std::memcpy(misplaced.data() + header.recordsOffset + i * sizeof(TraceRecord) + offsetof(TraceRecord, payload), &offset, sizeof(offset));
+            text = i;
+        }
+    }
+
+    writeFile(path, misplaced);
+
+    {
+        BinaryTraceReader reader(path);
+        check(reader[text].type == Message::Type::Text && reader[text].size > 0, "the trace has no text to misplace");
+        checkThrows([&] { reader.getText(reader[text]); }, "text outside the text section was read");
+    }
+
+    std::remove(path.c_str());
+}
+
+#ifdef __linux__
+// A trace that cannot be written in full says so when it is closed.
+static void testFullDiskTrace() {
+    PressDrill model;
+    BinaryTraceWriter writer("/dev/full");
+    model.sim.setTraceWriter(&writer);
+    model.sim.simulate();
+
+    checkThrows([&] { writer.close(); }, "a trace written to a full disk closed cleanly");
+}
+#endif
+
+//---------------------------------------------------
+// STATIC SIMULATOR
+//---------------------------------------------------
+
+// A second simulate() carries on from the first, taking the inputs added in
+// between, as a Simulator does.
+static void testStaticCarriesOn() {
+    Simulator sim;
+    Press press;
+    Drill drill;
+    sim.addModel(&press);
+    sim.addModel(&drill);
+    sim.addCoupling(&press, &drill);
+    sim.routeInputTo(&press);
+    sim.takeOutputFrom(&drill);
+
+    StaticSimulator<Models<Press, Drill>, Couplings<Input<0>, Connect<0, 1>, Output<1>>> composed;
+
+    sim.addInput(12, 1.5);
+    composed.addInput(12, 1.5);
+    checkTrace(sim.simulate(), composed.simulate());
+    check(composed.simulate().empty(), "a finished run ran again");
+
+    sim.addInput(2, 100.0);
+    sim.addInput(1, 100.0);
+    composed.addInput(2, 100.0);
+    composed.addInput(1, 100.0);
+    checkTrace(sim.simulate(), composed.simulate());
+    check(composed.getEventCount() == sim.getEventCount(), "the runs took different events");
+}
+
+//---------------------------------------------------
+// COUPLED MODELS
+//---------------------------------------------------
+
+// The press and drill each wrapped in a cell, and the cells in a line, so
+// that every coupling crosses a coupled model's ports. Flattened, the line
+// runs as the bare example does.
+static void testCoupledFlattening() {
+    Press press;
+    Drill drill;
+
+    CoupledModel pressCell;
+    pressCell.addModel(&press);
+    pressCell.addInputCoupling("in", &press, "in");
+    pressCell.addOutputCoupling(&press, "out", "out");
+
+    CoupledModel drillCell;
+    drillCell.addModel(&drill);
+    drillCell.addInputCoupling("in", &drill, "in");
+    drillCell.addOutputCoupling(&drill, "out", "out");
+
+    CoupledModel line;
+    line.addModel(&pressCell);
+    line.addModel(&drillCell);
+    line.addInputCoupling("in", &pressCell, "in");
+    line.addCoupling(&pressCell, "out", &drillCell, "in");
+    line.addOutputCoupling(&drillCell, "out", "out");
+
+    Simulator sim;
+    sim.addModel(&line);
+    sim.routeInputTo(&line);
+    sim.takeOutputFrom(&line);
+    addInputs(sim);
+
+    checkTrace(reference(), sim.simulate());
+}
+
+//---------------------------------------------------
+// ENSEMBLES
+//---------------------------------------------------
+
+// A random machine given a random number of parts, different in every
+// replication.
+static void setUpReplication(Replication& replication) {
+    RandomMachine* machine = replication.addModel<RandomMachine>(0.5, 1.0);
+    Simulator& sim = replication.getSimulator();
+
+    sim.routeInputTo(machine);
+    sim.takeOutputFrom(machine);
+    sim.addInput(static_cast<int>(1 + replication.getRandom()() % 8), 1.0);
+}
+
+// Replications come out the same whatever the number of threads they run
+// on, and differ from each other.
+static void testEnsemble() {
+    const std::size_t count = 16;
+    std::vector<std::string> serial = Ensemble(setUpReplication, 7, 1).run(count);
+    std::vector<std::string> parallel = Ensemble(setUpReplication, 7, 4).run(count);
+
+    for (std::size_t i = 0; i < count; i++) {
+        checkTrace(serial[i], parallel[i]);
+    }
+
+    check(serial[0] != serial[1], "two replications drew the same run");
+    check(Ensemble(setUpReplication, 8, 4).run(count)[0] != serial[0], "another seed drew the same run");
+}
+
+//---------------------------------------------------
+// MODEL ARRAYS
+//---------------------------------------------------
+
+// Machines feeding a drill, chained one after the other or all fed by the
+// first, as separate models or as the lanes of one MachineArray. Each lane
+// takes the transitions its machine would, so the drill sees the same
+// parts.
+static std::string runMachines(bool isChain, bool isArray) {
+    const std::size_t count = 4;
+
+    Simulator sim;
+    Drill drill;
+    MachineArray lanes(count, 2);
+    std::vector<std::unique_ptr<Machine>> machines;
+
+    sim.addModel(&drill);
+    sim.takeOutputFrom(&drill);
+
+    if (isArray) {
+        sim.addModel(&lanes);
+        sim.addCoupling(nullptr, 0, &lanes, 0);
+    }
+    else {
+        for (std::size_t i = 0; i < count; i++) {
+            machines.emplace_back(new Machine(2));
+            sim.addModel(machines.back().get());
+        }
+
+        sim.routeInputTo(machines[0].get());
+    }
+
+    for (std::size_t i = 1; i < count; i++) {
+        std::size_t source = isChain ? i - 1 : 0;
+
+        if (isArray) {
+            sim.addCoupling(&lanes, static_cast<PortId>(source), &lanes, static_cast<PortId>(i));
+        }
+        else {
+            sim.addCoupling(machines[source].get(), machines[i].get());
+        }
+    }
+
+    for (std::size_t i = isChain ? count - 1 : 1; i < count; i++) {
+        if (isArray) {
+            sim.addCoupling(&lanes, static_cast<PortId>(i), &drill, 0);
+        }
+        else {
+            sim.addCoupling(machines[i].get(), &drill);
+        }
+    }
+
+    addInputs(sim);
+
+    return sim.simulate();
+}
+
+static void testModelArray() {
+    checkTrace(runMachines(true, false), runMachines(true, true));
+    checkTrace(runMachines(false, false), runMachines(false, true));
+}
+
+//---------------------------------------------------
+// REAL TIME
+//---------------------------------------------------
+
+// A paced run takes the steps of a plain one, no sooner than the clock
+// allows, and waits for the end time even once its queue is empty.
+static void testRealTime() {
+    const double secondsPerUnit = 1e-4;
+    PressDrill model;
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    std::string output = model.sim.simulateRealTime(secondsPerUnit, 100.0);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    checkTrace(reference(), output);
+    check(seconds >= 100.0 * secondsPerUnit, "the run finished ahead of the clock");
+    check(model.sim.getPacingStatistics().steps > 0, "no paced steps were counted");
+}
+
+// Inputs injected from another thread arrive on the input couplings.
+static void testRealTimeInjection() {
+    PressDrill model;
+    std::string output;
+
+    std::thread run([&] { output = model.sim.simulateRealTime(1e-3, 100.0); });
+
+    for (int i = 0; i < 3; i++) {
+        model.sim.injectInput(1);
+    }
+
+    run.join();
+
+    // The example's 17 parts, and the three injected.
+    check(std::count(output.begin(), output.end(), '\n') == 17 + 3, "injected parts went missing:\n" + output);
+}
+
+//---------------------------------------------------
+// GRAPH PARTITIONER
+//---------------------------------------------------
+
+// Every part holds no more than its share of the weight, give or take the
+// imbalance and one vertex, and none is left empty.
+static void checkBalance(const GraphPartitioner& graph, const std::vector<double>& weights, std::size_t parts, double imbalance) {
+    std::vector<std::size_t> partOf = graph.partition(parts, imbalance);
+    std::vector<double> partWeights(parts, 0.0);
+    double total = 0.0;
+
+    for (std::size_t v = 0; v < weights.size(); v++) {
+        partWeights[partOf[v]] += weights[v];
+        total += weights[v];
+    }
+
+    double heaviest = *std::max_element(weights.begin(), weights.end());
+    double limit = total / parts * (1.0 + imbalance) + heaviest;
+
+    for (std::size_t part = 0; part < parts; part++) {
+        check(partWeights[part] > 0.0, "part " + std::to_string(part) + " of " + std::to_string(parts) + " is empty");
+        check(partWeights[part] <= limit, "part " + std::to_string(part) + " of " + std::to_string(parts) + " weighs " + std::to_string(partWeights[part])
+            + ", more than " + std::to_string(limit));
+    }
+}
+
+static void checkGridBalance(std::size_t width, const std::vector<std::size_t>& parts) {
+    GraphPartitioner graph(width * width);
+
+    for (std::size_t i = 0; i < width; i++) {
+        for (std::size_t j = 0; j < width; j++) {
+            if (i + 1 < width) {
+                graph.addEdge(i * width + j, (i + 1) * width + j, 1.0);
+            }
+
+            if (j + 1 < width) {
+                graph.addEdge(i * width + j, i * width + j + 1, 1.0);
+            }
+        }
+    }
+
+    for (std::size_t count : parts) {
+        checkBalance(graph, std::vector<double>(width * width, 1.0), count, 0.03);
+    }
+}
+
+static void checkRandomBalance(std::size_t vertices, std::size_t parts, std::uint64_t seed) {
+    std::mt19937_64 random(seed);
+    GraphPartitioner graph(vertices);
+    std::vector<double> weights(vertices);
+
+    for (std::size_t v = 0; v < vertices; v++) {
+        weights[v] = 1.0 + random() % 5;
+        graph.setVertexWeight(v, weights[v]);
+    }
+
+    for (std::size_t e = 0; e < 3 * vertices; e++) {
+        graph.addEdge(random() % vertices, random() % vertices, 1.0 + random() % 3);
+    }
+
+    checkBalance(graph, weights, parts, 0.03);
+}
+
+static void testPartitionBalance() {
+    checkGridBalance(100, { 2, 3, 5, 7, 16 });
+    checkGridBalance(300, { 16 });
+
+    for (std::uint64_t seed = 1; seed <= 8; seed++) {
+        checkRandomBalance(16, 10, seed);
+        checkRandomBalance(50, 16, seed);
+        checkRandomBalance(2000, 10, seed);
+    }
+}
+
+struct Test {
+    const char* name;
+    std::function<void()> run;
+};
+
+static std::vector<Test> tests() {
+    return {
+        { "binary", [] { checkTrace(reference(), runBackend(new BinaryHeapBackend())); } },
+        { "quaternary", [] { checkTrace(reference(), runBackend(new QuaternaryHeapBackend())); } },
+        { "calendar", [] { checkTrace(reference(), runBackend(new CalendarQueueBackend())); } },
+        { "parallel", [] { checkTrace(reference(), runParallel()); } },
+        { "static", [] { checkTrace(reference(), runStatic()); } },
+        { "conservative", [] { checkTrace(reference(), runDistributed<ConservativeSimulator>()); } },
+        { "optimistic", [] { checkTrace(reference(), runDistributed<OptimisticSimulator>()); } },
+        { "incremental", [] { checkTrace(reference(), runIncremental()); } },
+        { "checkpoint", [] { checkTrace(reference(), runCheckpointed()); } },
+        { "trace", [] { checkTrace(reference(), runTraced()); } },
+        { "fixed-point", testFixedPointGrouping },
+        { "calendar-far", [] { checkTrace(runFarInputs(new BinaryHeapBackend()), runFarInputs(new CalendarQueueBackend())); } },
+        { "random-rollback", testRandomUnderRollback },
+        { "source-inputs", testSourceMatchesInputs },
+        { "source-unrouted", testUnroutedSource },
+        { "sinks", testSinks },
+#ifdef __linux__
+        { "sink-full", testFullDiskSink },
+#endif
+        { "trace-corrupt", testCorruptTrace },
+#ifdef __linux__
+        { "trace-full", testFullDiskTrace },
+#endif
+        { "static-twice", testStaticCarriesOn },
+        { "partition-balance", testPartitionBalance },
+        { "real-time", testRealTime },
+        { "real-time-inject", testRealTimeInjection },
+        { "coupled", testCoupledFlattening },
+        { "ensemble", testEnsemble },
+        { "model-array", testModelArray },
+#ifdef DEVS_COROUTINES
+        { "process", [] { checkTrace(reference(), runProcess()); } },
+#endif
+    };
+}
+
+// Usage: Tests <name>; exits non-zero when the test fails.
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: Tests <name>" << std::endl;
+        return 2;
+    }
+
+    for (const Test& test : tests()) {
+        if (test.name == std::string(argv[1])) {
+            try {
+                test.run();
+            }
+            catch (const std::exception& failure) {
+                std::cerr << test.name << ": " << failure.what() << std::endl;
+                return 1;
+            }
+
+            return 0;
+        }
+    }
+
+    std::cerr << "unknown test: " << argv[1] << std::endl;
+
+    return 2;
+}